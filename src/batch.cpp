@@ -0,0 +1,592 @@
+
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <x86intrin.h>
+
+#include "lanes.h"
+#include "perft.h"
+#include "position.h"
+#include "telemetry.h"
+#include "uci.h"
+
+constexpr size_t ChunkSize = 1 << 20;
+
+struct Chunk
+{
+    const char *begin, *end;
+    std::string out;
+    uint64_t    positions;
+    NodeCount   nodes;
+    uint64_t    games, errors, parse_cycles, perft_cycles;
+    bool        done;
+};
+
+static void append_result(std::string& out, const char *fen, const char *fen_end, int depth, NodeCount nodes)
+{
+    char number[40];
+
+    out.append(fen, fen_end);
+    out.append(" ;D");
+    out.append(number, std::to_chars(number, number + sizeof(number), depth).ptr);
+    out.push_back(' ');
+    out.append(number, count_to_chars(nodes, number));
+    out.push_back('\n');
+}
+
+// Calls f(line, end) for every non-empty, non-comment line of the chunk
+
+template<typename F>
+void for_each_line(const Chunk& c, F f)
+{
+    for (const char *line = c.begin, *eol; line < c.end; line = eol + 1)
+    {
+        if (!(eol = (const char *)memchr(line, '\n', c.end - line)))
+            eol = c.end;
+
+        const char *end = eol > line && eol[-1] == '\r' ? eol - 1 : eol;
+
+        if (end != line && *line != '#')
+            f(line, end);
+    }
+}
+
+static void process(Chunk& c, int depth)
+{
+    c.out.reserve((c.end - c.begin) + (c.end - c.begin) / 4);
+
+    for_each_line(c, [&](const char *line, const char *end)
+    {
+        uint64_t t0 = __rdtsc();
+        const char *fen_end = Position::set(line, end);
+        uint64_t t1 = __rdtsc();
+
+        c.parse_cycles += t1 - t0;
+
+        if (!fen_end)
+        {
+            c.errors++;
+            return;
+        }
+
+        NodeCount nodes = Position::white_to_move() ? PerfT<false, WHITE>(depth)
+                                                    : PerfT<false, BLACK>(depth);
+        uint64_t t2 = __rdtsc();
+
+        append_result(c.out, line, fen_end, depth, nodes);
+
+        c.positions++;
+        c.nodes += nodes;
+        c.perft_cycles += t2 - t1;
+    });
+}
+
+// Same as process(), but the leaves are counted eight positions at a time by a
+// LaneCounter. Counts arrive on flush, so lines are formatted at the end of the
+// chunk; a deque keeps the counter addresses stable while it grows
+
+static void process_lanes(Chunk& c, int depth)
+{
+    LaneCounter lanes;
+    std::deque<uint64_t> counts;
+    std::vector<std::pair<const char *, const char *>> fens;
+
+    c.out.reserve((c.end - c.begin) + (c.end - c.begin) / 4);
+
+    for_each_line(c, [&](const char *line, const char *end)
+    {
+        uint64_t t0 = __rdtsc();
+        const char *fen_end = Position::set(line, end);
+        uint64_t t1 = __rdtsc();
+
+        c.parse_cycles += t1 - t0;
+
+        if (!fen_end)
+        {
+            c.errors++;
+            return;
+        }
+
+        counts.push_back(0);
+        fens.emplace_back(line, fen_end);
+
+        if (Position::white_to_move()) lane_perft<WHITE>(depth, lanes, &counts.back());
+        else                           lane_perft<BLACK>(depth, lanes, &counts.back());
+
+        c.perft_cycles += __rdtsc() - t1;
+    });
+
+    uint64_t t0 = __rdtsc();
+    lanes.flush();
+    c.perft_cycles += __rdtsc() - t0;
+
+    for (size_t i = 0; i < fens.size(); i++)
+    {
+        append_result(c.out, fens[i].first, fens[i].second, depth, counts[i]);
+        c.nodes += counts[i];
+    }
+
+    c.positions += fens.size();
+}
+
+// What a whole file run adds up to, for the commands to report
+
+struct Totals
+{
+    uint64_t  positions;
+    NodeCount nodes;
+    uint64_t  games, errors, parse_cycles, perft_cycles;
+    size_t    size;
+    double    us, tsc_per_us;
+};
+
+// Maps path, cuts it into chunks at the boundaries split(p, end) returns, runs
+// work(chunk) for every chunk on threads workers and writes the chunk outputs to
+// out_path, or stdout, in file order. A worker starts a chunk only when fewer
+// than InFlight chunks past the last written one are running or waiting, so a
+// slow writer holds back the workers instead of the whole output piling up in
+// memory. Returns false when a file can't be opened or written
+
+template<typename Split, typename Work>
+bool process_file(const std::string& path, const std::string& out_path, int threads, Split split, Work work, Totals& totals)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) || st.st_size == 0)
+    {
+        std::cout << "could not read " << path << "\n" << std::endl;
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    const char *data = (const char *)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        std::cout << "could not map " << path << "\n" << std::endl;
+        return false;
+    }
+
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    FILE *out = out_path.empty() ? stdout : fopen(out_path.c_str(), "w");
+
+    if (!out)
+    {
+        std::cout << "could not write " << out_path << "\n" << std::endl;
+        munmap((void *)data, size);
+        return false;
+    }
+
+    std::vector<Chunk> chunks;
+
+    for (const char *p = data, *end = data + size; p < end;)
+    {
+        const char *q = split(p + std::min<size_t>(ChunkSize, end - p), end);
+
+        chunks.push_back({ p, q });
+        p = q;
+    }
+
+    // Chunk outputs go out whole, so the stream's own buffer is left alone
+
+    const size_t InFlight = 2 * size_t(threads) + 1;
+
+    std::atomic<size_t>      next(0);
+    size_t                   written = 0;
+    bool                     failed  = false;
+    std::mutex               mutex;
+    std::condition_variable  cv;
+    std::vector<std::thread> workers;
+
+    auto     start     = std::chrono::steady_clock::now();
+    uint64_t tsc_start = __rdtsc();
+
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&]
+        {
+            for (size_t i; (i = next++) < chunks.size();)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&] { return i < written + InFlight; });
+                }
+
+                work(chunks[i]);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                chunks[i].done = true;
+                cv.notify_all();
+            }
+        });
+
+    totals = { 0, 0, 0, 0, 0, 0, size };
+
+    for (Chunk& c : chunks)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return c.done; });
+        }
+
+        failed |= fwrite(c.out.data(), 1, c.out.size(), out) != c.out.size();
+        std::string().swap(c.out);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            written++;
+        }
+
+        cv.notify_all();
+
+        Telemetry::progress(&c - chunks.data() + 1, chunks.size());
+
+        totals.positions    += c.positions;
+        totals.nodes        += c.nodes;
+        totals.games        += c.games;
+        totals.errors       += c.errors;
+        totals.parse_cycles += c.parse_cycles;
+        totals.perft_cycles += c.perft_cycles;
+    }
+
+    for (std::thread& th : workers)
+        th.join();
+
+    failed |= fflush(out) != 0;
+
+    if (out != stdout)
+        failed |= fclose(out) != 0;
+
+    munmap((void *)data, size);
+
+    if (failed)
+    {
+        std::cout << "could not write " << (out_path.empty() ? "stdout" : out_path) << "\n" << std::endl;
+        return false;
+    }
+
+    totals.us         = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() + 1;
+    totals.tsc_per_us = (__rdtsc() - tsc_start) / totals.us;
+
+    return true;
+}
+
+// Chunk boundary at the first line start from q on
+
+static const char *next_line(const char *q, const char *end)
+{
+    const void *nl = q < end ? memchr(q, '\n', end - q) : nullptr;
+    return nl ? (const char *)nl + 1 : end;
+}
+
+void Batch::run(const std::string& path, int depth, const std::string& out_path, int threads, bool use_lanes)
+{
+    Totals t;
+
+    // Lane counters are 64 bits wide, deeper runs fall back to the scalar count
+
+    auto work = [&](Chunk& c)
+    {
+        if (use_lanes && depth <= NarrowDepth) process_lanes(c, depth);
+        else           process(c, depth);
+    };
+
+    if (!process_file(path, out_path, threads, next_line, work, t))
+        return;
+
+    double parse_us = t.parse_cycles / t.tsc_per_us + 1;
+    double perft_us = t.perft_cycles / t.tsc_per_us + 1;
+
+    std::cout << "\nPositions: " << t.positions << "\nUnreadable fens: " << t.errors << "\nNodes searched: " << count_to_string(t.nodes)
+              << "\nParse: " << uint64_t(parse_us / 1000) << " ms thread time, "
+              << uint64_t(t.positions / parse_us * 1e6) << " fens/s, " << uint64_t(t.size / parse_us) << " MB/s"
+              << "\nPerft: " << uint64_t(perft_us / 1000) << " ms thread time, "
+              << uint64_t(double(t.nodes) / perft_us * 1e6) << " nodes/s"
+              << "\nIn " << uint64_t(t.us / 1000) << " ms\n" << std::endl;
+}
+
+constexpr char StartFen[] = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// Writes the current position of a replayed game, with its perft when depth > 0
+
+static void emit(Chunk& c, int depth)
+{
+    char fen[MAX_FEN_LENGTH], *fen_end = Position::fen(fen);
+
+    if (depth > 0)
+    {
+        uint64_t t0 = __rdtsc();
+        NodeCount nodes = Position::white_to_move() ? PerfT<false, WHITE>(depth)
+                                                    : PerfT<false, BLACK>(depth);
+        c.perft_cycles += __rdtsc() - t0;
+        c.nodes += nodes;
+
+        append_result(c.out, fen, fen_end, depth, nodes);
+    }
+    else
+    {
+        c.out.append(fen, fen_end);
+        c.out.push_back('\n');
+    }
+
+    c.positions++;
+}
+
+static bool is_space(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+// One game per line: "[startpos | fen <fen>] [moves] <uci> <uci> ...". A game
+// stops at its first move that is not legal, which counts as an error
+
+static void replay_uci(Chunk& c, int depth)
+{
+    for_each_line(c, [&](const char *p, const char *end)
+    {
+        auto token_end = [&] { const char *q = p; while (q < end && !is_space(*q)) q++; return q; };
+        auto skip      = [&] { while (p < end && is_space(*p)) p++; };
+
+        skip();
+
+        const char *q = token_end();
+
+        if (q - p == 8 && !memcmp(p, "position", 8))
+            p = q, skip(), q = token_end();
+
+        c.games++;
+
+        // A fen that doesn't parse fails the whole game
+
+        if (q - p == 3 && !memcmp(p, "fen", 3))
+        {
+            if (!(p = Position::set(q, end)))
+            {
+                c.errors++;
+                return;
+            }
+        }
+        else
+        {
+            Position::set(StartFen, StartFen + sizeof(StartFen) - 1);
+
+            if (q - p == 8 && !memcmp(p, "startpos", 8))
+                p = q;
+        }
+
+        emit(c, depth);
+
+        // Move counters of a fen and the "moves" keyword are skipped
+
+        for (skip(); p < end; skip())
+        {
+            q = token_end();
+
+            if (*p >= '0' && *p <= '9' || q - p == 5 && !memcmp(p, "moves", 5))
+            {
+                p = q;
+                continue;
+            }
+
+            Move m = uci_to_move(p, q);
+
+            if (!m)
+            {
+                c.errors++;
+                break;
+            }
+
+            Position::commit_move(m);
+            emit(c, depth);
+            p = q;
+        }
+    });
+}
+
+static bool is_result(const char *p, const char *q)
+{
+    return q - p == 1 && *p == '*'
+        || q - p == 3 && (!memcmp(p, "1-0", 3) || !memcmp(p, "0-1", 3))
+        || q - p == 7 && !memcmp(p, "1/2-1/2", 7);
+}
+
+// PGN: tag pairs, of which only FEN is used, then SAN movetext. Comments,
+// variations, NAGs and move numbers are skipped
+
+static void replay_pgn(Chunk& c, int depth)
+{
+    const char *fen = nullptr, *fen_end = nullptr;
+    bool in_tags = false, in_game = false, failed = false;
+
+    for (const char *p = c.begin, *end = c.end, *q; p < end; p = q)
+    {
+        if (is_space(*p))
+        {
+            q = p + 1;
+            continue;
+        }
+
+        if (*p == '[' || *p == '%')
+        {
+            if (!(q = (const char *)memchr(p, '\n', end - p)))
+                q = end;
+
+            if (*p == '%')
+                continue;
+
+            if (!in_tags)
+                in_tags = true, in_game = false, fen = nullptr;
+
+            if (q - p > 6 && !memcmp(p, "[FEN \"", 6))
+            {
+                fen     = p + 6;
+                fen_end = (const char *)memchr(fen, '"', q - fen);
+            }
+
+            continue;
+        }
+
+        if (*p == '{' || *p == ';')
+        {
+            q = (const char *)memchr(p, *p == '{' ? '}' : '\n', end - p);
+            q = q ? q + 1 : end;
+            continue;
+        }
+
+        if (*p == '(')
+        {
+            int nesting = 0;
+
+            for (q = p; q < end; q++)
+                if (*q == '{')
+                    q = std::find(q, end, '}');
+                else if (*q == '(')
+                    nesting++;
+                else if (*q == ')' && !--nesting)
+                    break;
+
+            q = q < end ? q + 1 : end;
+            continue;
+        }
+
+        for (q = p; q < end && !is_space(*q) && *q != '{' && *q != '(' && *q != ';'; q++);
+
+        if (*p == '$' || *p == ')')
+            continue;
+
+        if (is_result(p, q))
+        {
+            in_game = false, fen = nullptr;
+            continue;
+        }
+
+        // A FEN tag without its closing quote, or with a fen that doesn't parse,
+        // fails the whole game
+
+        if (!in_game)
+        {
+            in_tags = false, in_game = true;
+            c.games++;
+
+            failed = fen ? !fen_end || !Position::set(fen, fen_end)
+                         : !Position::set(StartFen, StartFen + sizeof(StartFen) - 1);
+
+            if (failed)
+                c.errors++;
+            else
+                emit(c, depth);
+        }
+
+        // Move numbers, also when glued to the move as in "12.e4" or "12...Nf6".
+        // Digits only count as one when a '.' follows, so that "0-0" stays a move
+
+        const char *san = p, *digits = p;
+
+        while (digits < q && *digits >= '0' && *digits <= '9')
+            digits++;
+
+        if (digits == q || *digits == '.')
+            for (san = digits; san < q && *san == '.'; san++);
+
+        if (san == q || failed)
+            continue;
+
+        if (Move m = san_to_move(san, q))
+        {
+            Position::commit_move(m);
+            emit(c, depth);
+        }
+        else
+            failed = true, c.errors++;
+    }
+}
+
+// PGN chunks end where a tag section follows the blank line after movetext
+
+static const char *next_game(const char *q, const char *end)
+{
+    for (q = next_line(q, end); q < end; q = next_line(q, end))
+    {
+        const char *eol = q - 1;
+
+        if (*q == '[' && (eol[-1] == '\n' || eol[-1] == '\r' && eol[-2] == '\n'))
+            return q;
+    }
+
+    return end;
+}
+
+void Batch::replay(const std::string& path, int depth, const std::string& out_path, int threads)
+{
+    // A file is PGN when its first character, past any blank space, opens a tag
+
+    bool pgn = false;
+
+    if (FILE *f = fopen(path.c_str(), "r"))
+    {
+        int ch;
+        while ((ch = fgetc(f)) != EOF && is_space(ch));
+        pgn = ch == '[';
+        fclose(f);
+    }
+
+    Totals t;
+
+    auto work = [&](Chunk& c)
+    {
+        if (pgn) replay_pgn(c, depth);
+        else     replay_uci(c, depth);
+    };
+
+    if (!(pgn ? process_file(path, out_path, threads, next_game, work, t)
+              : process_file(path, out_path, threads, next_line, work, t)))
+        return;
+
+    double perft_us = t.perft_cycles / t.tsc_per_us + 1;
+
+    std::cout << "\nGames: " << t.games << (pgn ? " (pgn)" : " (uci)") << "\nPositions: " << t.positions
+              << "\nIllegal or unreadable moves and fens: " << t.errors;
+
+    if (depth > 0)
+        std::cout << "\nNodes searched: " << count_to_string(t.nodes) << "\nPerft: " << uint64_t(perft_us / 1000)
+                  << " ms thread time, " << uint64_t(double(t.nodes) / perft_us * 1e6) << " nodes/s";
+
+    std::cout << "\nIn " << uint64_t(t.us / 1000) << " ms (" << uint64_t(t.positions / t.us * 1e6) << " positions/s)\n" << std::endl;
+}
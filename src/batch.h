@@ -0,0 +1,20 @@
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+
+namespace Batch
+{
+    // Runs perft(depth) on every fen/epd line of a memory-mapped file and writes
+    // "<fen> ;D<depth> <nodes>" lines to out, or stdout when out is empty. With
+    // lanes the last ply is counted by the vectorized LaneCounter
+    void run(const std::string& path, int depth, const std::string& out, int threads, bool lanes = false);
+
+    // Replays every game of a file of UCI move lines, "[startpos | fen <fen>]
+    // [moves] <uci>...", or of PGN, and writes each position reached as a fen
+    // line, or as "<fen> ;D<depth> <nodes>" when depth > 0
+    void replay(const std::string& path, int depth, const std::string& out, int threads);
+}
+
+#endif
@@ -0,0 +1,149 @@
+
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "movegen.h"
+#include "perft.h"
+#include "position.h"
+#include "uci.h"
+
+struct Leaf
+{
+    Bitboard  bitboards[16];
+    Piece     board[SQUARE_NB];
+    StateInfo state;
+
+    void restore() const
+    {
+        memcpy(::bitboards, bitboards, sizeof(bitboards));
+        memcpy(::board, board, sizeof(board));
+        *state_ptr = state;
+    }
+};
+
+// The corpus keeps every stride-th leaf, so deep trees stay within MaxLeaves
+// (about 50 MB) however many leaves they have
+
+constexpr uint64_t MaxLeaves = 1 << 18;
+
+template<Color Us>
+void collect(std::vector<Leaf>& leaves, int depth, uint64_t stride, uint64_t& seen)
+{
+    if (depth == 0)
+    {
+        if (seen++ % stride || leaves.size() == MaxLeaves)
+            return;
+
+        leaves.emplace_back();
+        memcpy(leaves.back().bitboards, bitboards, sizeof(bitboards));
+        memcpy(leaves.back().board, board, sizeof(board));
+        leaves.back().state = *state_ptr;
+        return;
+    }
+
+    Move list[128], *end = generate_moves<Us>(list);
+
+    for (Move *m = list; m != end; m++)
+    {
+        do_move<Us>(*m);
+        state_ptr->side_to_move = !Us;
+        collect<!Us>(leaves, depth - 1, stride, seen);
+        undo_move<Us>(*m);
+    }
+}
+
+// Runs f(p) over every leaf, appending to a 1 MB buffer that is recycled when
+// full, and returns the elapsed time in microseconds. The checksum keeps the
+// output observable
+
+template<typename F>
+double measure(const std::vector<Leaf>& leaves, uint64_t& checksum, F f)
+{
+    static char buffer[1 << 20];
+
+    char *p = buffer;
+    auto start = std::chrono::steady_clock::now();
+
+    for (const Leaf& leaf : leaves)
+    {
+        if (p > buffer + sizeof(buffer) - 4096)
+            checksum += p[-1], p = buffer;
+
+        leaf.restore();
+        p = f(p);
+    }
+
+    checksum += p - buffer;
+
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() + 1;
+}
+
+void Bench::serialize(int depth)
+{
+    std::vector<Leaf> leaves;
+    uint64_t checksum = 0, moves = 0;
+    Leaf root;
+
+    root.state = *state_ptr;
+    memcpy(root.bitboards, bitboards, sizeof(bitboards));
+    memcpy(root.board, board, sizeof(board));
+
+    uint64_t total  = Position::white_to_move() ? PerfT<false, WHITE>(depth) : PerfT<false, BLACK>(depth);
+    uint64_t stride = (total + MaxLeaves - 1) / MaxLeaves, seen = 0;
+
+    leaves.reserve(std::min(total, MaxLeaves));
+
+    if (Position::white_to_move()) collect<WHITE>(leaves, depth, std::max<uint64_t>(1, stride), seen);
+    else                           collect<BLACK>(leaves, depth, std::max<uint64_t>(1, stride), seen);
+
+    double restore_us = measure(leaves, checksum, [](char *p) { return p; });
+
+    double fen_us = measure(leaves, checksum, [](char *p) {
+        *(p = Position::fen(p)) = '\n';
+        return p + 1;
+    });
+
+    double string_us = measure(leaves, checksum, [](char *p) {
+        std::string fen = Position::fen();
+        memcpy(p, fen.data(), fen.size());
+        return p + fen.size();
+    });
+
+    double uci_us = measure(leaves, checksum, [&](char *p) {
+        Move list[128], *end = Position::white_to_move() ? generate_moves<WHITE>(list) : generate_moves<BLACK>(list);
+        for (Move *m = list; m != end; m++)
+            *(p = move_to_uci(*m, p)) = ' ', p++;
+        moves += end - list;
+        return p;
+    });
+
+    double divide_us = measure(leaves, checksum, [](char *p) {
+        Move list[128], *end = Position::white_to_move() ? generate_moves<WHITE>(list) : generate_moves<BLACK>(list);
+        for (Move *m = list; m != end; m++)
+            p = divide_line(*m, end - list, p);
+        return p;
+    });
+
+    double movegen_us = measure(leaves, checksum, [](char *p) {
+        Move list[128], *end = Position::white_to_move() ? generate_moves<WHITE>(list) : generate_moves<BLACK>(list);
+        return p + (end - list > 200);
+    });
+
+    root.restore();
+
+    auto rate = [](uint64_t n, double us) { return uint64_t(n / (us > 1 ? us : 1) * 1e6); };
+
+    // Restoring the leaf (and generating its moves) is timed on its own and subtracted
+
+    std::cout << "\nPositions: " << leaves.size() << " of " << total << " leaves" << "\nMoves: " << moves
+              << "\nfen(char *): "     << rate(leaves.size(), fen_us    - restore_us) << " positions/s"
+              << "\nfen() string: "    << rate(leaves.size(), string_us - restore_us) << " positions/s"
+              << "\nmove_to_uci: "     << rate(moves, uci_us    - movegen_us) << " moves/s"
+              << "\ndivide_line: "     << rate(moves, divide_us - movegen_us) << " lines/s"
+              << "\nChecksum: " << checksum << "\n" << std::endl;
+}
@@ -0,0 +1,12 @@
+
+#ifndef BENCH_H
+#define BENCH_H
+
+namespace Bench
+{
+    // Serializes every leaf position at depth below the current one, and their
+    // moves, into a memory buffer and reports fens/s, moves/s and divide lines/s
+    void serialize(int depth);
+}
+
+#endif
@@ -37,7 +37,7 @@ void Bitboards::init()
 {
     for (Square s1 = H1; s1 <= A8; s1++)
     {
-        FileBB[s1] = FILE_H << s1 % 8;
+        KingLines[s1].file = FILE_H << s1 % 8;
 
         for (Square s2 = H1; s2 <= A8; s2++)
             SquareDistance[s1][s2] = std::max(file_distance(s1, s2), rank_distance(s1, s2));
@@ -45,29 +45,41 @@ void Bitboards::init()
 
     init_magics();
 
+    int lines = 1;
+
     for (Square s1 = H1; s1 <= A8; s1++)
     {
-        MainDiag[s1] = bishop_attacks(s1, 0) & (mask(s1, NORTH_WEST) | mask(s1, SOUTH_EAST)) | square_bb(s1);
-        AntiDiag[s1] = bishop_attacks(s1, 0) & (mask(s1, NORTH_EAST) | mask(s1, SOUTH_WEST)) | square_bb(s1);
-        
+        SquareInfo& info = Squares[s1];
+
+        KingLines[s1].main_diag = bishop_attacks(s1, 0) & (mask(s1, NORTH_WEST) | mask(s1, SOUTH_EAST)) | square_bb(s1);
+        KingLines[s1].anti_diag = bishop_attacks(s1, 0) & (mask(s1, NORTH_EAST) | mask(s1, SOUTH_WEST)) | square_bb(s1);
+
+        Rays[s1].line[0] = KingLines[s1].file      ^ square_bb(s1);
+        Rays[s1].line[1] = rank_bb(s1)             ^ square_bb(s1);
+        Rays[s1].line[2] = KingLines[s1].main_diag ^ square_bb(s1);
+        Rays[s1].line[3] = KingLines[s1].anti_diag ^ square_bb(s1);
+
         for (Square s2 = H1; s2 <= A8; s2++)
             if (PieceType pt; attacks_bb(pt=BISHOP, s1, 0) & square_bb(s2) || attacks_bb(pt=ROOK, s1, 0) & square_bb(s2))
             {
-                CheckRay [s1][s2] = attacks_bb(pt, s1, square_bb(s2)) & attacks_bb(pt, s2, square_bb(s1)) | square_bb(s2);
-                AlignMask[s1][s2] = attacks_bb(pt, s1, 0)             & attacks_bb(pt, s2, 0)             | square_bb(s1, s2);
+                Bitboard line = attacks_bb(pt, s1, 0) & attacks_bb(pt, s2, 0) | square_bb(s1, s2);
+                int i = std::find(LineBB, LineBB + lines, line) - LineBB;
+
+                if (i == lines)
+                    LineBB[lines++] = line;
+
+                LineIndex[s1][s2] = i;
             }
 
         for (Direction d : { NORTH, NORTH_EAST, EAST, SOUTH_EAST, SOUTH, SOUTH_WEST, WEST, NORTH_WEST })
-            KingAttacks[s1] |= safe_step(s1, d);
+            info.king |= safe_step(s1, d);
 
         for (Direction d : { NORTH+NORTH_EAST, NORTH_EAST+EAST, SOUTH_EAST+EAST, SOUTH+SOUTH_EAST,
                              SOUTH+SOUTH_WEST, SOUTH_WEST+WEST, NORTH_WEST+WEST, NORTH+NORTH_WEST })
-            KnightAttacks[s1] |= safe_step(s1, d);
+            info.knight |= safe_step(s1, d);
 
-        DoubleCheck[s1] = KingAttacks[s1] | KnightAttacks[s1];
-
-        PawnAttacks[WHITE][s1] = pawn_attacks<WHITE>(square_bb(s1));
-        PawnAttacks[BLACK][s1] = pawn_attacks<BLACK>(square_bb(s1));
+        info.pawn[WHITE] = pawn_attacks<WHITE>(square_bb(s1));
+        info.pawn[BLACK] = pawn_attacks<BLACK>(square_bb(s1));
     }
     
     uint8_t clearK = 0b0111;
@@ -102,24 +114,21 @@ void Bitboards::init()
 
 void init_magics()
 {
-    Bitboard *pext = pext_table, *xray = xray_table;
+    Bitboard *pext = pext_table;
 
     for (PieceType pt : { BISHOP, ROOK })
-    {
-        int      *base = pt == BISHOP ? bishop_base  : rook_base;
-        Bitboard *mask = pt == BISHOP ? bishop_masks : rook_masks;
-
         for (Square s = H1; s <= A8; s++)
         {
-            base[s] = pext - pext_table;
-            mask[s] = attacks_bb(pt, s, 0) & ~((FILE_A | FILE_H) & ~file_bb(s) | (RANK_1 | RANK_8) & ~rank_bb(s));
+            Bitboard&        mask  = pt == BISHOP ? Squares[s].bishop_mask  : Squares[s].rook_mask;
+            const Bitboard *&table = pt == BISHOP ? Squares[s].bishop_table : Squares[s].rook_table;
 
-            for (Bitboard occupied = 0, i = 0; i < 1 << popcount(mask[s]); occupied = generate_occupancy(mask[s], ++i))
+            table = pext;
+            mask  = attacks_bb(pt, s, 0) & ~((FILE_A | FILE_H) & ~file_bb(s) | (RANK_1 | RANK_8) & ~rank_bb(s));
+
+            for (Bitboard occupied = 0, i = 0; i < 1 << popcount(mask); occupied = generate_occupancy(mask, ++i), pext++)
             {
-                *pext++ = attacks_bb(pt, s, occupied);
-                *xray++ = attacks_bb(pt, s, occupied ^ attacks_bb(pt, s, occupied) & occupied);
+                pext[0]               = attacks_bb(pt, s, occupied);
+                pext[SliderTableSize] = attacks_bb(pt, s, occupied ^ attacks_bb(pt, s, occupied) & occupied);
             }
         }
-    }
 }
-
@@ -5,6 +5,7 @@
 #include <cmath>
 #include <immintrin.h>
 
+#include "hyperbola.h"
 #include "types.h"
 
 #define pext(b, m) _pext_u64(b, m)
@@ -13,24 +14,45 @@
 
 namespace Bitboards { void init(); }
 
-inline Bitboard pext_table[0x1a480];
-inline Bitboard xray_table[0x1a480];
+constexpr int SliderTableSize = 0x1a480;
 
-inline Bitboard bishop_masks[SQUARE_NB];
-inline Bitboard rook_masks[SQUARE_NB];
+// Slider attacks for every relevant occupancy of every square, followed at
+// SliderTableSize by the xrays: the attacks through the first blockers
 
-inline int bishop_base[SQUARE_NB];
-inline int rook_base[SQUARE_NB];
+inline Bitboard pext_table[2 * SliderTableSize];
+
+// Everything looked up by a single square, one cache line each. The table
+// pointers already point at the square's slice of pext_table
+
+struct alignas(64) SquareInfo
+{
+    Bitboard        bishop_mask;
+    const Bitboard *bishop_table;
+    Bitboard        rook_mask;
+    const Bitboard *rook_table;
+    Bitboard        knight, king;
+    Bitboard        pawn[COLOR_NB];
+};
+
+inline SquareInfo Squares[SQUARE_NB];
+
+// The lines through the king a pinned pawn may still move along, read once per
+// generate_moves() call
+
+struct alignas(32) SquareLines
+{
+    Bitboard file, main_diag, anti_diag;
+};
+
+inline SquareLines KingLines[SQUARE_NB];
+
+// Square pairs map to the full line (file, rank or diagonal) through both, by a
+// byte index into a table of the 42 lines holding two or more squares. Index 0
+// is the empty line used for squares that are not aligned
+
+inline Bitboard LineBB[64];
+inline uint8_t  LineIndex[SQUARE_NB][SQUARE_NB];
 
-inline Bitboard DoubleCheck[SQUARE_NB];
-inline Bitboard KnightAttacks[SQUARE_NB];
-inline Bitboard KingAttacks[SQUARE_NB];
-inline Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
-inline Bitboard CheckRay[SQUARE_NB][SQUARE_NB];
-inline Bitboard AlignMask[SQUARE_NB][SQUARE_NB];
-inline Bitboard MainDiag[SQUARE_NB];
-inline Bitboard AntiDiag[SQUARE_NB];
-inline Bitboard FileBB[SQUARE_NB];
 inline uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
 inline uint8_t castle_masks[COLOR_NB][1 << 5];
 
@@ -85,28 +107,41 @@ constexpr Bitboard shift(Bitboard bb)
     if constexpr (D == SOUTH+SOUTH) return  bb >> 16;
 }
 
+inline Bitboard line_bb(Square a, Square b) {
+    return LineBB[LineIndex[a][b]];
+}
+
 inline Bitboard align_mask(Square ksq, Square pinned) {
-    return AlignMask[ksq][pinned];
+    return line_bb(ksq, pinned);
 }
 
 inline Bitboard main_diag(Square s) {
-    return MainDiag[s];
+    return KingLines[s].main_diag;
 }
 
 inline Bitboard anti_diag(Square s) {
-    return AntiDiag[s];
+    return KingLines[s].anti_diag;
 }
 
 inline Bitboard file_bb(Square s) {
-    return FileBB[s];
+    return KingLines[s].file;
 }
 
 inline Bitboard double_check(Square ksq) {
-    return DoubleCheck[ksq];
+    return Squares[ksq].knight | Squares[ksq].king;
+}
+
+// Squares strictly between a and b, empty when they are not aligned. The line
+// is cut to [min, max) by two shifts and the lowest bit, min itself, dropped
+
+inline Bitboard between_bb(Square a, Square b)
+{
+    Bitboard ray = line_bb(a, b) & ((ALL_SQUARES << a) ^ (ALL_SQUARES << b));
+    return _blsr_u64(ray);
 }
 
 inline Bitboard check_ray(Square ksq, Square checker) {
-    return CheckRay[ksq][checker];
+    return between_bb(ksq, checker) | 1ull << checker;
 }
 
 constexpr Bitboard square_bb(Square s) {
@@ -161,36 +196,62 @@ inline uint64_t more_than_one(Bitboard b) {
 }
 
 inline Bitboard knight_attacks(Square sq) {
-    return KnightAttacks[sq];
+    return Squares[sq].knight;
 }
 
-inline Bitboard bishop_attacks(Square sq, Bitboard occupied) {
-    return pext_table[bishop_base[sq] + pext(occupied, bishop_masks[sq])];
+// Slider lookups go to the pext tables, or with hyperbola_sliders set to the
+// table-free kernels of hyperbola.h. Only set it where Hyperbola::supported()
+
+inline bool hyperbola_sliders = false;
+
+inline Bitboard bishop_attacks(Square sq, Bitboard occupied)
+{
+    if (__builtin_expect(hyperbola_sliders, false))
+        return Hyperbola::bishop_attacks(sq, occupied);
+
+    return Squares[sq].bishop_table[pext(occupied, Squares[sq].bishop_mask)];
 }
 
-inline Bitboard bishop_xray(Square sq, Bitboard occupied) {
-    return xray_table[bishop_base[sq] + pext(occupied, bishop_masks[sq])];
+inline Bitboard bishop_xray(Square sq, Bitboard occupied)
+{
+    if (__builtin_expect(hyperbola_sliders, false))
+        return Hyperbola::bishop_xray(sq, occupied);
+
+    return Squares[sq].bishop_table[pext(occupied, Squares[sq].bishop_mask) + SliderTableSize];
 }
 
-inline Bitboard rook_attacks(Square sq, Bitboard occupied) {
-    return pext_table[rook_base[sq] + pext(occupied, rook_masks[sq])];
+inline Bitboard rook_attacks(Square sq, Bitboard occupied)
+{
+    if (__builtin_expect(hyperbola_sliders, false))
+        return Hyperbola::rook_attacks(sq, occupied);
+
+    return Squares[sq].rook_table[pext(occupied, Squares[sq].rook_mask)];
 }
 
-inline Bitboard rook_xray(Square sq, Bitboard occupied) {
-    return xray_table[rook_base[sq] + pext(occupied, rook_masks[sq])];
+inline Bitboard rook_xray(Square sq, Bitboard occupied)
+{
+    if (__builtin_expect(hyperbola_sliders, false))
+        return Hyperbola::rook_xray(sq, occupied);
+
+    return Squares[sq].rook_table[pext(occupied, Squares[sq].rook_mask) + SliderTableSize];
 }
 
-inline Bitboard queen_attacks(Square sq, Bitboard occupied) {
-    return pext_table[bishop_base[sq] + pext(occupied, bishop_masks[sq])] | pext_table[rook_base[sq] + pext(occupied, rook_masks[sq])];
+inline Bitboard queen_attacks(Square sq, Bitboard occupied)
+{
+    if (__builtin_expect(hyperbola_sliders, false))
+        return Hyperbola::queen_attacks(sq, occupied);
+
+    return Squares[sq].bishop_table[pext(occupied, Squares[sq].bishop_mask)]
+         | Squares[sq].rook_table[pext(occupied, Squares[sq].rook_mask)];
 }
 
 inline Bitboard king_attacks(Square sq) {
-    return KingAttacks[sq];
+    return Squares[sq].king;
 }
 
 template<Color C>
 constexpr Bitboard pawn_attacks(Square sq) {
-    return PawnAttacks[C][sq];
+    return Squares[sq].pawn[C];
 }
 
 template<Color C>
@@ -0,0 +1,180 @@
+
+#include "cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+
+// Entries are written without locks. check holds key ^ nodes ^ high ^ meta, so
+// an entry torn by concurrent writers fails verification and reads as a miss.
+// high holds the upper 64 bits of the count
+
+struct Entry
+{
+    uint64_t check;
+    uint64_t nodes;
+    uint64_t meta;
+    uint64_t high;
+
+    int depth()      const { return meta & 0xff; }
+    int generation() const { return meta >> 8 & 0xffff; }
+};
+
+constexpr int BucketSize = 4;
+
+struct Bucket {
+    Entry entry[BucketSize];
+};
+
+struct Header
+{
+    char     magic[8];
+    uint64_t buckets;
+    uint64_t generation;
+    uint64_t reserved[5];
+};
+
+constexpr char Magic[8] = { 'P', 'E', 'R', 'F', 'T', 'C', '0', '3' };
+
+static int      fd = -1;
+static size_t   mapped;
+static Header  *header;
+static Bucket  *buckets;
+static uint64_t generation;
+
+static uint64_t relaxed_load(const uint64_t& x) {
+    return __atomic_load_n(&x, __ATOMIC_RELAXED);
+}
+
+static void relaxed_store(uint64_t& x, uint64_t v) {
+    __atomic_store_n(&x, v, __ATOMIC_RELAXED);
+}
+
+static Bucket& bucket(uint64_t key, int depth) {
+    return buckets[(unsigned __int128)(key + depth * 0x9e3779b97f4a7c15ull) * header->buckets >> 64];
+}
+
+bool Cache::open(const std::string& path, size_t mb)
+{
+    close();
+
+    if ((fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644)) < 0)
+        return false;
+
+    // The first process to get here sizes and formats the file, everybody else attaches
+
+    flock(fd, LOCK_EX);
+
+    // A file too short for the header would fault on the magic check below.
+    // Closing the descriptor releases the lock
+
+    struct stat st;
+
+    if (fstat(fd, &st) || st.st_size && size_t(st.st_size) < sizeof(Header))
+    {
+        close();
+        return false;
+    }
+
+    bool fresh = st.st_size == 0;
+    size_t size = fresh ? sizeof(Header) + std::max<size_t>(1, (mb << 20) / sizeof(Bucket)) * sizeof(Bucket)
+                        : st.st_size;
+
+    void *p = fresh && ftruncate(fd, size) ? MAP_FAILED : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (p != MAP_FAILED)
+    {
+        header  = (Header *)p;
+        buckets = (Bucket *)(header + 1);
+        mapped  = size;
+
+        if (fresh)
+        {
+            header->buckets = (size - sizeof(Header)) / sizeof(Bucket);
+            memcpy(header->magic, Magic, sizeof(Magic));
+        }
+
+        if (memcmp(header->magic, Magic, sizeof(Magic)) || size != sizeof(Header) + header->buckets * sizeof(Bucket))
+        {
+            munmap(p, size);
+            p = MAP_FAILED;
+            header = nullptr;
+        }
+        else
+            generation = __atomic_add_fetch(&header->generation, 1, __ATOMIC_RELAXED) & 0xffff;
+    }
+
+    flock(fd, LOCK_UN);
+
+    if (p == MAP_FAILED)
+        close();
+
+    return enabled();
+}
+
+void Cache::close()
+{
+    if (header)
+        munmap(header, mapped);
+
+    if (fd >= 0)
+        ::close(fd);
+
+    header = nullptr, fd = -1;
+}
+
+bool Cache::enabled() {
+    return header;
+}
+
+bool Cache::probe(uint64_t key, int depth, NodeCount& nodes)
+{
+    for (Entry& e : bucket(key, depth).entry)
+    {
+        uint64_t check = relaxed_load(e.check), n = relaxed_load(e.nodes), meta = relaxed_load(e.meta);
+        uint64_t high  = relaxed_load(e.high);
+
+        if ((meta & 0xff) == depth && (check ^ n ^ high ^ meta) == key)
+            return nodes = NodeCount(high) << 64 | n, Telemetry::cache_hit(), true;
+    }
+
+    Telemetry::cache_miss();
+    return false;
+}
+
+// Replacement prefers entries left by older sessions, then the shallowest ones,
+// which are the cheapest to recompute
+
+void Cache::store(uint64_t key, int depth, NodeCount nodes)
+{
+    Entry *replace = nullptr;
+    int    worst   = 1 << 30;
+
+    for (Entry& e : bucket(key, depth).entry)
+    {
+        Entry copy = { relaxed_load(e.check), relaxed_load(e.nodes), relaxed_load(e.meta), relaxed_load(e.high) };
+
+        if (copy.depth() == depth && (copy.check ^ copy.nodes ^ copy.high ^ copy.meta) == key)
+        {
+            replace = &e;
+            break;
+        }
+
+        if (int score = (copy.generation() == generation) * 256 + copy.depth(); score < worst)
+            worst = score, replace = &e;
+    }
+
+    uint64_t meta = depth | generation << 8;
+    uint64_t low  = nodes, high = nodes >> 64;
+
+    relaxed_store(replace->nodes, low);
+    relaxed_store(replace->high, high);
+    relaxed_store(replace->meta, meta);
+    relaxed_store(replace->check, key ^ low ^ high ^ meta);
+}
@@ -0,0 +1,23 @@
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <string>
+
+#include "types.h"
+
+// Persistent (key, depth) -> nodes cache, backed by a memory-mapped file that
+// several processes may read and write at the same time
+
+namespace Cache
+{
+    bool open(const std::string& path, size_t mb);
+    void close();
+    bool enabled();
+
+    bool probe(uint64_t key, int depth, NodeCount& nodes);
+    void store(uint64_t key, int depth, NodeCount nodes);
+}
+
+#endif
@@ -0,0 +1,238 @@
+
+#include "drill.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "perft.h"
+#include "position.h"
+#include "uci.h"
+
+struct Node
+{
+    Move      move;
+    NodeCount nodes;
+    bool      expanded;
+    std::vector<Node> children;
+};
+
+static std::string      root_fen;
+static int              root_depth = -1;
+static Node             root;
+static std::vector<int> path;
+
+static Node& current()
+{
+    Node *node = &root;
+
+    for (int i : path)
+        node = &node->children[i];
+
+    return *node;
+}
+
+static int current_depth() {
+    return root_depth - path.size();
+}
+
+// Counts every child of the current node, splitting each child's count by its own
+// moves so that entering a child afterwards needs no search
+
+template<Color Us>
+void expand(Node& node, int depth)
+{
+    Move list[128], *end = generate_moves<Us>(list);
+
+    node.nodes = 0;
+    node.children.clear();
+
+    for (Move *m = list; m != end; m++)
+    {
+        Node child = { *m, depth == 1, depth == 1 };
+
+        do_move<Us>(*m);
+
+        if (depth > 1)
+        {
+            Move grand[128], *grand_end = generate_moves<!Us>(grand);
+
+            for (Move *g = grand; g != grand_end; g++)
+            {
+                do_move<!Us>(*g);
+                NodeCount count = PerfT<false, Us>(depth - 2);
+                undo_move<!Us>(*g);
+
+                child.children.push_back({ *g, count, depth == 2 });
+                child.nodes += count;
+            }
+
+            child.expanded = true;
+        }
+
+        undo_move<Us>(*m);
+
+        node.nodes += child.nodes;
+        node.children.push_back(std::move(child));
+    }
+
+    node.expanded = true;
+}
+
+static void show()
+{
+    Node& node = current();
+    int depth = current_depth();
+
+    auto start = std::chrono::steady_clock::now();
+    bool searched = !node.expanded && depth > 0;
+
+    if (searched)
+    {
+        if (Position::white_to_move()) expand<WHITE>(node, depth);
+        else                           expand<BLACK>(node, depth);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "\n";
+
+    for (Node& child : node.children)
+    {
+        char line[48];
+        std::cout.write(line, divide_line(child.move, child.nodes, line) - line);
+    }
+
+    std::cout << "\nPosition: " << Position::fen() << "\nDepth: " << depth
+              << "\nNodes searched: " << count_to_string(depth > 0 ? node.nodes : 1) << "\n";
+
+    if (searched)
+        std::cout << "In " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms\n";
+    else
+        std::cout << "From stored counts\n";
+
+    std::cout << std::endl;
+}
+
+static void sync_position()
+{
+    Node *node = &root;
+
+    Position::set(root_fen);
+
+    for (int i : path)
+    {
+        node = &node->children[i];
+        Position::commit_move(node->move);
+    }
+}
+
+void Drill::divide(int depth)
+{
+    root_fen   = Position::fen();
+    root_depth = depth;
+    root       = Node();
+    path.clear();
+
+    show();
+}
+
+void Drill::enter(const std::string& uci)
+{
+    if (root_depth < 0)
+    {
+        std::cout << "no divide session, use divide <depth> first\n" << std::endl;
+        return;
+    }
+
+    std::vector<Node>& children = current().children;
+
+    for (size_t i = 0; i < children.size(); i++)
+        if (move_to_uci(children[i].move) == uci)
+        {
+            path.push_back(i);
+            sync_position();
+            show();
+            return;
+        }
+
+    std::cout << "no move " << uci << " at this node\n" << std::endl;
+}
+
+void Drill::up()
+{
+    if (path.empty())
+    {
+        std::cout << "already at the root\n" << std::endl;
+        return;
+    }
+
+    path.pop_back();
+    sync_position();
+    show();
+}
+
+// Reads "<move>: <count>" lines, e.g. a divide of the same position from another
+// program, and enters the first move whose count differs
+
+void Drill::compare(const std::string& file)
+{
+    std::ifstream in(file);
+    std::map<std::string, NodeCount> reference;
+
+    for (std::string line, uci, number; std::getline(in, line);)
+    {
+        std::istringstream is(line);
+        NodeCount count;
+
+        if (is >> uci >> number && uci.back() == ':' && string_to_count(number, count))
+            uci.pop_back(), reference[uci] = count;
+    }
+
+    if (root_depth < 0 || reference.empty())
+    {
+        std::cout << (reference.empty() ? "no divide lines in " + file : "no divide session") << "\n" << std::endl;
+        return;
+    }
+
+    Node& node = current();
+    int first_diff = -1;
+    bool differs = false;
+
+    for (size_t i = 0; i < node.children.size(); i++)
+    {
+        std::string uci = move_to_uci(node.children[i].move);
+        auto it = reference.find(uci);
+
+        if (it == reference.end())
+            std::cout << "extra move " << uci << "\n", differs = true;
+
+        else
+        {
+            if (it->second != node.children[i].nodes)
+            {
+                std::cout << uci << ": " << count_to_string(node.children[i].nodes) << " expected " << count_to_string(it->second) << "\n";
+
+                if (first_diff < 0)
+                    first_diff = i;
+            }
+
+            reference.erase(it);
+        }
+    }
+
+    for (auto& [uci, count] : reference)
+        std::cout << "missing move " << uci << "\n", differs = true;
+
+    if (differs)
+        std::cout << "\nThe move lists differ at " << Position::fen() << "\n" << std::endl;
+
+    else if (first_diff >= 0)
+        enter(move_to_uci(node.children[first_diff].move));
+
+    else
+        std::cout << "\nAll counts match\n" << std::endl;
+}
@@ -0,0 +1,18 @@
+
+#ifndef DRILL_H
+#define DRILL_H
+
+#include <string>
+
+// Divide drill-down session. Every count computed is kept in a tree, so moving
+// between nodes only searches subtrees that were never counted
+
+namespace Drill
+{
+    void divide(int depth);
+    void enter(const std::string& uci);
+    void up();
+    void compare(const std::string& path);
+}
+
+#endif
@@ -0,0 +1,228 @@
+
+#include "estimate.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "misc.h"
+#include "movegen.h"
+#include "perft.h"
+#include "position.h"
+
+// Plies counted exactly at the end of every path. The last ply is a bulk count
+// and nearly free; a perft(2) tail costs more than the variance it removes
+constexpr int ExactTail = 1;
+
+// Importance sampling draws only the first plies of a path by weight, where
+// subtree sizes differ most. Weighing every ply costs a move generation per
+// child and loses to uniform draws for the same time
+constexpr int WeightedPlies = 2;
+
+// Per stratum sums of the path estimates, merged over threads at the end
+
+struct Stratum
+{
+    uint64_t    n;
+    long double sum, sum_sq;
+
+    void add(long double x) {
+        n++, sum += x, sum_sq += x * x;
+    }
+
+    long double mean() const {
+        return sum / n;
+    }
+
+    // Variance of the mean, only defined for n > 1
+    long double variance() const {
+        return (sum_sq - sum * sum / n) / (n - 1) / n;
+    }
+};
+
+// One random path below the current position: the product of the inverse
+// probabilities of the moves chosen, times the exact count at the tail. The
+// expected value over paths is perft(depth)
+
+template<Color Us>
+long double sample(int depth, int weighted, PRNG& rng)
+{
+    if (depth <= ExactTail)
+        return PerfT<false, Us>(depth);
+
+    Move list[128], *end = generate_moves<Us>(list);
+    int n = end - list;
+
+    if (!n)
+        return 0;
+
+    if (!weighted)
+    {
+        Move m = list[rng.below(n)];
+
+        do_move<Us>(m);
+        long double x = sample<!Us>(depth - 1, 0, rng);
+        undo_move<Us>(m);
+
+        return n * x;
+    }
+
+    // Children are drawn in proportion to their own move counts, which track
+    // subtree size far better than a uniform choice. A child without moves has
+    // an empty subtree and is never drawn
+
+    int weight[128], total = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        Move child[128];
+
+        do_move<Us>(list[i]);
+        total += weight[i] = generate_moves<!Us>(child) - child;
+        undo_move<Us>(list[i]);
+    }
+
+    if (!total)
+        return 0;
+
+    int i = 0;
+
+    for (int r = rng.below(total); r >= weight[i]; r -= weight[i++]);
+
+    do_move<Us>(list[i]);
+    long double x = sample<!Us>(depth - 1, weighted - 1, rng);
+    undo_move<Us>(list[i]);
+
+    return x * total / weight[i];
+}
+
+// With more than one stratum, each stratum is a root move
+
+template<Color Us>
+long double sample_root(int depth, int weighted, int strata, Move *root_moves, int stratum, PRNG& rng)
+{
+    if (strata == 1)
+        return sample<Us>(depth, weighted, rng);
+
+    do_move<Us>(root_moves[stratum]);
+    long double x = sample<!Us>(depth - 1, weighted, rng);
+    undo_move<Us>(root_moves[stratum]);
+
+    return x;
+}
+
+void Estimate::run(int depth, const std::string& mode, uint64_t samples, double seconds, int threads)
+{
+    if (mode != "uniform" && mode != "importance" && mode != "stratified")
+    {
+        std::cout << "unknown mode " << mode << ", use uniform, importance or stratified\n" << std::endl;
+        return;
+    }
+
+    std::string root = Position::fen();
+    bool white = Position::white_to_move();
+
+    Move root_moves[128];
+    int  strata = mode == "stratified" && depth > ExactTail ? (white ? generate_moves<WHITE>(root_moves)
+                                                                     : generate_moves<BLACK>(root_moves)) - root_moves : 1;
+
+    int weighted = mode == "importance" ? WeightedPlies : 0;
+    bool exact   = depth <= ExactTail;
+
+    if (exact)
+        samples = 1, seconds = 0;
+
+    // A root without moves has perft 0, which one unstratified path finds as well.
+    // A stratum needs two samples for a variance, a sample budget that can't give
+    // every root move two falls back to unstratified uniform sampling
+
+    if (!strata)
+        strata = 1;
+
+    if (strata > 1 && seconds <= 0 && samples < 2 * uint64_t(strata))
+    {
+        std::cout << "\n" << samples << " samples are fewer than 2 per root move, sampling without strata" << std::endl;
+        strata = 1;
+    }
+
+    // The deadline is not checked before every stratum has its two samples
+
+    uint64_t minimum = strata > 1 ? 2 * uint64_t(strata) : 2;
+
+    auto start    = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration<double>(seconds);
+
+    std::vector<std::vector<Stratum>> results(threads, std::vector<Stratum>(strata));
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&, t]
+        {
+            PRNG rng(0x5851f42d4c957f2dull * (t + 1));
+            std::vector<Stratum>& result = results[t];
+
+            Position::set(root);
+
+            // Samples t, t + threads, ... round robin over the strata, so every
+            // stratum gets its share whenever the run stops
+
+            for (uint64_t i = t; seconds > 0 || i < samples; i += threads)
+            {
+                if (seconds > 0 && i >= minimum && i % (64 * threads) == uint64_t(t) && std::chrono::steady_clock::now() > deadline)
+                    break;
+
+                int s = i % strata;
+                result[s].add(white ? sample_root<WHITE>(depth, weighted, strata, root_moves, s, rng)
+                                    : sample_root<BLACK>(depth, weighted, strata, root_moves, s, rng));
+            }
+        });
+
+    for (std::thread& th : workers)
+        th.join();
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    // Strata are independent: their means and variances add up. Without two
+    // samples in every stratum there is no interval to report
+
+    long double estimate = 0, variance = 0;
+    uint64_t    taken    = 0;
+    bool        bounded  = true;
+
+    for (int s = 0; s < strata; s++)
+    {
+        Stratum merged = {};
+
+        for (std::vector<Stratum>& result : results)
+            merged.n += result[s].n, merged.sum += result[s].sum, merged.sum_sq += result[s].sum_sq;
+
+        if (merged.n)
+            estimate += merged.mean();
+
+        if (merged.n > 1)
+            variance += merged.variance();
+        else
+            bounded = false;
+
+        taken += merged.n;
+    }
+
+    long double half = 1.96 * std::sqrt(variance);
+    char interval[96];
+
+    if (exact)
+        snprintf(interval, sizeof(interval), "exact");
+    else if (!bounded)
+        snprintf(interval, sizeof(interval), "unknown, fewer than 2 samples");
+    else
+        snprintf(interval, sizeof(interval), "%.6Le .. %.6Le (+-%.3Lf%%)",
+                 estimate - half, estimate + half, estimate > 0 ? 100 * half / estimate : 0);
+
+    std::cout << "\nEstimated nodes: " << count_to_string(NodeCount(std::roundl(estimate)))
+              << "\n95% interval: " << interval
+              << "\nSamples: " << taken << " (" << (strata == 1 && mode == "stratified" ? "uniform" : mode) << ", " << taken * 1000 / (ms + 1) << " paths/s)"
+              << "\nIn " << ms << " ms\n" << std::endl;
+}
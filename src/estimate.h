@@ -0,0 +1,20 @@
+
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <stdint.h>
+#include <string>
+
+namespace Estimate
+{
+    // Monte Carlo perft(depth) of the current position from random paths, each
+    // finished by an exact perft of the last plies. Mode is "uniform" (Knuth's
+    // estimator), "importance" (children drawn by their move counts) or
+    // "stratified" (uniform paths below evenly shared root moves). Runs until
+    // samples paths are taken, or for seconds when that is positive.
+    // Stratified runs take at least 2 paths per root move, a smaller samples
+    // count falls back to unstratified uniform paths
+    void run(int depth, const std::string& mode, uint64_t samples, double seconds, int threads);
+}
+
+#endif
@@ -0,0 +1,94 @@
+
+#ifndef HYPERBOLA_H
+#define HYPERBOLA_H
+
+#include <immintrin.h>
+
+#include "types.h"
+
+// Table-free slider attacks by hyperbola quintessence. Along one line through
+// the slider, occupied - slider borrows up to the first blocker above it, and the
+// same on the bit-reversed board finds the first blocker below. GFNI reverses
+// the bits of every byte and a byte shuffle the bytes, so all lines of a piece
+// go through side by side in one vector, without touching the pext tables
+
+// The file, rank and both diagonals through a square, without the square itself
+
+struct alignas(32) SquareRays {
+    Bitboard line[4];
+};
+
+inline SquareRays Rays[SQUARE_NB];
+
+// The entry points stay out of line, so that the table path of the callers in
+// bitboard.h keeps its code size
+
+#define HYPERBOLA_TARGET __attribute__((target("gfni,avx2,bmi2")))
+#define HYPERBOLA_ENTRY  __attribute__((target("gfni,avx2,bmi2"), noinline))
+
+namespace Hyperbola
+{
+    inline bool supported() {
+        return __builtin_cpu_supports("gfni") && __builtin_cpu_supports("avx2");
+    }
+
+    constexpr long long ReverseBits = 0x8040201008040201ll;
+
+    HYPERBOLA_TARGET inline __m128i reverse(__m128i x)
+    {
+        x = _mm_gf2p8affine_epi64_epi8(x, _mm_set1_epi64x(ReverseBits), 0);
+        return _mm_shuffle_epi8(x, _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7));
+    }
+
+    HYPERBOLA_TARGET inline __m256i reverse(__m256i x)
+    {
+        x = _mm256_gf2p8affine_epi64_epi8(x, _mm256_set1_epi64x(ReverseBits), 0);
+        return _mm256_shuffle_epi8(x, _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+                                                      8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7));
+    }
+
+    // Two lines of sq, lines 0 and 1 for a rook, 2 and 3 for a bishop
+
+    HYPERBOLA_TARGET inline Bitboard pair_attacks(Square sq, Bitboard occupied, int first)
+    {
+        __m128i mask = _mm_load_si128((const __m128i *)&Rays[sq].line[first]);
+        __m128i o    = _mm_and_si128(_mm_set1_epi64x(occupied), mask);
+        __m128i up   = _mm_sub_epi64(o, _mm_set1_epi64x(1ull << sq));
+        __m128i down = _mm_sub_epi64(reverse(o), _mm_set1_epi64x(1ull << (63 - sq)));
+        __m128i a    = _mm_and_si128(_mm_xor_si128(up, reverse(down)), mask);
+
+        return _mm_cvtsi128_si64(a) | _mm_extract_epi64(a, 1);
+    }
+
+    HYPERBOLA_ENTRY inline Bitboard rook_attacks(Square sq, Bitboard occupied) {
+        return pair_attacks(sq, occupied, 0);
+    }
+
+    HYPERBOLA_ENTRY inline Bitboard bishop_attacks(Square sq, Bitboard occupied) {
+        return pair_attacks(sq, occupied, 2);
+    }
+
+    HYPERBOLA_ENTRY inline Bitboard queen_attacks(Square sq, Bitboard occupied)
+    {
+        __m256i mask = _mm256_load_si256((const __m256i *)Rays[sq].line);
+        __m256i o    = _mm256_and_si256(_mm256_set1_epi64x(occupied), mask);
+        __m256i up   = _mm256_sub_epi64(o, _mm256_set1_epi64x(1ull << sq));
+        __m256i down = _mm256_sub_epi64(reverse(o), _mm256_set1_epi64x(1ull << (63 - sq)));
+        __m256i a    = _mm256_and_si256(_mm256_xor_si256(up, reverse(down)), mask);
+        __m128i b    = _mm_or_si128(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+
+        return _mm_cvtsi128_si64(b) | _mm_extract_epi64(b, 1);
+    }
+
+    // Attacks through the first blockers, the same as the xray tables hold
+
+    HYPERBOLA_ENTRY inline Bitboard rook_xray(Square sq, Bitboard occupied) {
+        return pair_attacks(sq, occupied ^ (pair_attacks(sq, occupied, 0) & occupied), 0);
+    }
+
+    HYPERBOLA_ENTRY inline Bitboard bishop_xray(Square sq, Bitboard occupied) {
+        return pair_attacks(sq, occupied ^ (pair_attacks(sq, occupied, 2) & occupied), 2);
+    }
+}
+
+#endif
@@ -0,0 +1,262 @@
+
+#include "lanes.h"
+
+#include <cstring>
+#include <immintrin.h>
+#include <type_traits>
+
+#include "telemetry.h"
+
+// Eight 64-bit lanes. On AVX-512 builds this is one zmm register, otherwise a
+// plain array the compiler is free to vectorize
+
+#ifdef __AVX512F__
+
+struct V
+{
+    __m512i v;
+
+    V(__m512i x) : v(x) {}
+    V(Bitboard b) : v(_mm512_set1_epi64(b)) {}
+
+    static V load(const uint64_t *p) { return _mm512_load_si512(p); }
+    void store(uint64_t *p) const { _mm512_store_si512(p, v); }
+
+    friend V operator&(V a, V b) { return _mm512_and_si512(a.v, b.v); }
+    friend V operator|(V a, V b) { return _mm512_or_si512(a.v, b.v); }
+    friend V operator+(V a, V b) { return _mm512_add_epi64(a.v, b.v); }
+    friend V operator~(V a) { return _mm512_ternarylogic_epi64(a.v, a.v, a.v, 0x55); }
+
+    template<int N> V shl() const { return _mm512_slli_epi64(v, N); }
+    template<int N> V shr() const { return _mm512_srli_epi64(v, N); }
+
+#ifdef __AVX512VPOPCNTDQ__
+    V bit_count() const { return _mm512_popcnt_epi64(v); }
+#else
+    V bit_count() const
+    {
+        alignas(64) uint64_t x[8];
+        store(x);
+        for (uint64_t& b : x) b = _mm_popcnt_u64(b);
+        return load(x);
+    }
+#endif
+
+    V if_any()  const { return _mm512_maskz_set1_epi64(_mm512_test_epi64_mask(v, v), 1); }
+    V if_none() const { return _mm512_maskz_set1_epi64(_mm512_testn_epi64_mask(v, v), 1); }
+
+    V all_if_any()  const { return _mm512_maskz_set1_epi64(_mm512_test_epi64_mask(v, v), -1); }
+    V all_if_none() const { return _mm512_maskz_set1_epi64(_mm512_testn_epi64_mask(v, v), -1); }
+};
+
+#else
+
+struct V
+{
+    uint64_t v[8];
+
+    V() = default;
+    V(Bitboard b) { for (uint64_t& x : v) x = b; }
+
+    template<typename F>
+    static V map(F f) { V r; for (int i = 0; i < 8; i++) r.v[i] = f(i); return r; }
+
+    static V load(const uint64_t *p) { return map([&](int i) { return p[i]; }); }
+    void store(uint64_t *p) const { memcpy(p, v, sizeof(v)); }
+
+    friend V operator&(V a, V b) { return map([&](int i) { return a.v[i] & b.v[i]; }); }
+    friend V operator|(V a, V b) { return map([&](int i) { return a.v[i] | b.v[i]; }); }
+    friend V operator+(V a, V b) { return map([&](int i) { return a.v[i] + b.v[i]; }); }
+    friend V operator~(V a)      { return map([&](int i) { return ~a.v[i]; }); }
+
+    template<int N> V shl() const { return map([&](int i) { return v[i] << N; }); }
+    template<int N> V shr() const { return map([&](int i) { return v[i] >> N; }); }
+
+    V bit_count()   const { return map([&](int i) { return uint64_t(popcount(v[i])); }); }
+    V if_any()      const { return map([&](int i) { return uint64_t(v[i] != 0); }); }
+    V if_none()     const { return map([&](int i) { return uint64_t(v[i] == 0); }); }
+    V all_if_any()  const { return map([&](int i) { return v[i] ? ALL_SQUARES : 0; }); }
+    V all_if_none() const { return map([&](int i) { return v[i] ? 0 : ALL_SQUARES; }); }
+};
+
+#endif
+
+template<int S>
+V shift(V b)
+{
+    if constexpr (S > 0) return b.template shl<S>();
+    else                 return b.template shr<-S>();
+}
+
+// Kogge-Stone fill: every square reached from gen in one direction, up to and
+// including the first blocker. Mask removes the file a shift would wrap onto
+
+template<int S, Bitboard Mask>
+V slide(V gen, V empty)
+{
+    V pro = empty & Mask;
+
+    gen = gen | pro & shift<S>(gen);
+    pro = pro & shift<S>(pro);
+    gen = gen | pro & shift<2 * S>(gen);
+    pro = pro & shift<2 * S>(pro);
+    gen = gen | pro & shift<4 * S>(gen);
+
+    return shift<S>(gen) & Mask;
+}
+
+template<int Shift, Bitboard Mask, bool Diagonal, int Line>
+struct Ray
+{
+    static constexpr int      S        = Shift;
+    static constexpr Bitboard M        = Mask;
+    static constexpr bool     diagonal = Diagonal;
+    static constexpr int      line     = Line;
+};
+
+template<typename F>
+void for_each_ray(F f)
+{
+    f(Ray< 8, ALL_SQUARES, false, 0>());
+    f(Ray<-8, ALL_SQUARES, false, 0>());
+    f(Ray< 1, NOT_FILE_H,  false, 1>());
+    f(Ray<-1, NOT_FILE_A,  false, 1>());
+    f(Ray< 7, NOT_FILE_A,  true,  2>());
+    f(Ray<-7, NOT_FILE_H,  true,  2>());
+    f(Ray< 9, NOT_FILE_H,  true,  3>());
+    f(Ray<-9, NOT_FILE_A,  true,  3>());
+}
+
+constexpr Bitboard NOT_FILE_GH = ~(FILE_G | FILE_H);
+constexpr Bitboard NOT_FILE_AB = ~(FILE_A | FILE_B);
+
+template<typename F>
+void for_each_knight_step(F f)
+{
+    f(std::integral_constant<int,  17>(), NOT_FILE_H);
+    f(std::integral_constant<int,  15>(), NOT_FILE_A);
+    f(std::integral_constant<int,  10>(), NOT_FILE_GH);
+    f(std::integral_constant<int,   6>(), NOT_FILE_AB);
+    f(std::integral_constant<int,  -6>(), NOT_FILE_GH);
+    f(std::integral_constant<int, -10>(), NOT_FILE_AB);
+    f(std::integral_constant<int, -15>(), NOT_FILE_H);
+    f(std::integral_constant<int, -17>(), NOT_FILE_A);
+}
+
+static V knight_attacks(V b)
+{
+    V a = 0;
+    for_each_knight_step([&](auto s, Bitboard mask) { a = a | shift<decltype(s)::value>(b) & mask; });
+    return a;
+}
+
+static V king_attacks(V b)
+{
+    V a = shift<8>(b) | shift<-8>(b);
+    V h = b | a;
+    return a | shift<1>(h) & NOT_FILE_H | shift<-1>(h) & NOT_FILE_A;
+}
+
+void LaneCounter::flush()
+{
+    if (!size)
+        return;
+
+    for (int i = size; i < Width; i++)
+    {
+        for (PieceType pt = 0; pt <= KING; pt++)
+            us[pt][i] = them[pt][i] = 0;
+
+        castle_k[i] = castle_q[i] = 0;
+    }
+
+    V pawns   = V::load(us[PAWN]),   knights = V::load(us[KNIGHT]);
+    V bishops = V::load(us[BISHOP]), rooks   = V::load(us[ROOK]),  queens = V::load(us[QUEEN]);
+    V king    = V::load(us[KING]),   own     = V::load(us[0]);
+
+    V enemy_pawns = V::load(them[PAWN]), enemy_knights = V::load(them[KNIGHT]), enemy_king = V::load(them[KING]);
+    V enemy_bq    = V::load(them[BISHOP]) | V::load(them[QUEEN]);
+    V enemy_rq    = V::load(them[ROOK])   | V::load(them[QUEEN]);
+    V enemy       = V::load(them[0]);
+
+    V empty   = ~(own | enemy);
+    V empty_k = empty | king;
+
+    // Enemy attacks with our king removed, checks, and pins per line through the king
+
+    V seen      = shift<-7>(enemy_pawns) & NOT_FILE_H | shift<-9>(enemy_pawns) & NOT_FILE_A
+                | knight_attacks(enemy_knights) | king_attacks(enemy_king);
+    V checkmask = knight_attacks(king) & enemy_knights
+                | (shift<7>(king) & NOT_FILE_A | shift<9>(king) & NOT_FILE_H) & enemy_pawns;
+    V checkers  = checkmask.bit_count();
+    V pinned    = 0;
+    V pin[4]    = { 0, 0, 0, 0 };
+
+    for_each_ray([&](auto r)
+    {
+        using R = decltype(r);
+
+        V sliders = R::diagonal ? enemy_bq : enemy_rq;
+        V ray     = slide<R::S, R::M>(king, empty);
+        V hit     = ray & sliders;
+        V blocker = ray & own;
+        V pin_ray = slide<R::S, R::M>(blocker, empty) & sliders;
+        V p       = blocker & pin_ray.all_if_any();
+
+        seen      = seen | slide<R::S, R::M>(sliders, empty_k);
+        checkmask = checkmask | ray & hit.all_if_any();
+        checkers  = checkers + hit.if_any();
+        pin[R::line] = pin[R::line] | p;
+        pinned    = pinned | p;
+    });
+
+    V target   = ~own & (checkmask | checkers.all_if_none());
+    V unpinned = ~pinned;
+    V count    = 0;
+
+    // Knights and sliders, one direction at a time: moves in one direction from
+    // different pieces never share a (from, to) pair, so popcounts add up
+
+    V movable_knights = knights & unpinned;
+
+    for_each_knight_step([&](auto s, Bitboard mask) {
+        count = count + (shift<decltype(s)::value>(movable_knights) & mask & target).bit_count();
+    });
+
+    for_each_ray([&](auto r)
+    {
+        using R = decltype(r);
+
+        V movers = (R::diagonal ? bishops | queens : rooks | queens) & (unpinned | pin[R::line]);
+        count = count + (slide<R::S, R::M>(movers, empty) & target).bit_count();
+    });
+
+    V push  = shift<8>(pawns & (unpinned | pin[0])) & empty;
+    V push2 = shift<8>(push & RANK_3) & empty & target;
+    V capl  = shift<7>(pawns & (unpinned | pin[2])) & NOT_FILE_A & enemy & target;
+    V capr  = shift<9>(pawns & (unpinned | pin[3])) & NOT_FILE_H & enemy & target;
+    V promo = (push & target & RANK_8).bit_count() + (capl & RANK_8).bit_count() + (capr & RANK_8).bit_count();
+
+    push  = push & target;
+    count = count + push.bit_count() + push2.bit_count() + capl.bit_count() + capr.bit_count() + promo + promo + promo;
+
+    V castles = (V::load(castle_k) & (~empty & square_bb(F1, G1)).if_none()     & (seen & square_bb(E1, F1, G1)).if_none())
+              + (V::load(castle_q) & (~empty & square_bb(B1, C1, D1)).if_none() & (seen & square_bb(C1, D1, E1)).if_none());
+
+    // Only king moves survive a double check
+
+    V single = shift<-1>(checkers).all_if_none();
+    V result = (king_attacks(king) & ~own & ~seen).bit_count() + ((count + castles) & single);
+
+    alignas(64) uint64_t out[Width];
+    result.store(out);
+
+    uint64_t nodes = 0;
+
+    for (int i = 0; i < size; i++)
+        *owner[i] += out[i], nodes += out[i];
+
+    Telemetry::nodes(nodes);
+
+    size = 0;
+}
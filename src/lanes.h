@@ -0,0 +1,93 @@
+
+#ifndef LANES_H
+#define LANES_H
+
+#include "movegen.h"
+#include "position.h"
+#include "types.h"
+
+// Experimental lockstep leaf counter. Up to eight positions are stored as a
+// structure of arrays, one per 64-bit lane, from the side to move's point of view
+// (black to move is flipped vertically). Attack maps, checks, pins and perft(1)
+// are then computed set-wise for all lanes at once, in AVX-512 registers when
+// the build has them
+
+class LaneCounter
+{
+public:
+    static constexpr int Width = 8;
+
+    // Adds perft(1) of the current position to *counter, at the latest on flush()
+    template<Color Us>
+    void push(uint64_t *counter);
+
+    void flush();
+
+private:
+    // Indexed by PieceType, [0] holds all pieces of the side
+    alignas(64) uint64_t us[KING + 1][Width], them[KING + 1][Width];
+    alignas(64) uint64_t castle_k[Width], castle_q[Width];
+
+    uint64_t *owner[Width];
+    int       size = 0;
+};
+
+template<Color Us>
+void LaneCounter::push(uint64_t *counter)
+{
+    constexpr Color Them = !Us;
+
+    // An ep capture needs the scalar discovered check test, and is rare enough
+    // to hand the whole position to generate_moves()
+
+    if (state_ptr->ep_sq && pawn_attacks<Them>(state_ptr->ep_sq) & bitboards[make_piece(Us, PAWN)])
+    {
+        Move list[128];
+        *counter += generate_moves<Us>(list) - list;
+        return;
+    }
+
+    auto flip = [](Bitboard b) { return Us == WHITE ? b : __builtin_bswap64(b); };
+
+    for (PieceType pt = PAWN; pt <= KING; pt++)
+    {
+        us  [pt][size] = flip(bitboards[make_piece(Us,   pt)]);
+        them[pt][size] = flip(bitboards[make_piece(Them, pt)]);
+    }
+
+    us  [0][size] = flip(bitboards[Us]);
+    them[0][size] = flip(bitboards[Them]);
+
+    castle_k[size] = bool(state_ptr->castling_rights & (Us == WHITE ? 0b1000 : 0b0010));
+    castle_q[size] = bool(state_ptr->castling_rights & (Us == WHITE ? 0b0100 : 0b0001));
+
+    owner[size] = counter;
+
+    if (++size == Width)
+        flush();
+}
+
+// Counts the leaves depth plies below the current position into *counter,
+// handing every position one ply above the leaves to lanes
+
+template<Color Us>
+void lane_perft(int depth, LaneCounter& lanes, uint64_t *counter)
+{
+    if (depth <= 1)
+    {
+        if (depth == 0) ++*counter;
+        else            lanes.push<Us>(counter);
+        return;
+    }
+
+    Move list[128], *end = generate_moves<Us>(list);
+
+    for (Move *m = list; m != end; m++)
+    {
+        do_move<Us>(*m);
+        lane_perft<!Us>(depth - 1, lanes, counter);
+        undo_move<Us>(*m);
+    }
+}
+
+#endif
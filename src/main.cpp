@@ -3,53 +3,42 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
+#include "batch.h"
+#include "bench.h"
 #include "bitboard.h"
+#include "cache.h"
+#include "drill.h"
+#include "estimate.h"
 #include "movegen.h"
+#include "packed.h"
+#include "perft.h"
+#include "telemetry.h"
+#include "traverse.h"
+#include "tt.h"
 #include "position.h"
 #include "types.h"
 #include "uci.h"
+#include "verify.h"
 
 void position(std::istringstream& is)
 {
+    const std::string startpos = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
     std::string token, fen;
 
     is >> token;
 
     if (token == "startpos")
-        fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+        fen = startpos;
     else
         for (;is >> token; fen += token + " ");
 
-    Position::set(fen);
-}
-
-template<bool Root, Color SideToMove>
-uint64_t PerfT(int depth)
-{
-    if (depth == 0)
-        return 1;
-
-    Move list[128], *end = generate_moves<SideToMove>(list);
-
-    if (depth == 1 && !Root)
-        return end - list;
-
-    uint64_t count, nodes = 0;
-    
-    for (Move *m = list; m != end; m++)
+    if (!Position::set(fen))
     {
-        do_move<SideToMove>(*m);
-        count = PerfT<false, !SideToMove>(depth - 1);
-        undo_move<SideToMove>(*m);
-
-        nodes += count;
-
-        if (Root)
-            std::cout << move_to_uci(*m) << ": " << count << std::endl;
+        std::cout << "invalid fen, back to the start position\n" << std::endl;
+        Position::set(startpos);
     }
-
-    return nodes;
 }
 
 void debug()
@@ -63,14 +52,17 @@ void debug()
         
         std::istringstream is(token.substr(token.find(';')));
 
-        for (uint64_t depth = is.str()[2] - '0', expected; is >> token >> expected; depth++)
+        for (std::string number; is >> token >> number;)
         {
+            int       depth = std::stoi(token.substr(2));
+            NodeCount expected;
+
             std::cout << "Perft " << depth << " " << Position::fen() << std::endl;
             
-            uint64_t result = Position::white_to_move() ? PerfT<false, WHITE>(depth)
-                                                        : PerfT<false, BLACK>(depth);
+            NodeCount result = Position::white_to_move() ? CachedPerfT<false, WHITE>(depth)
+                                                         : CachedPerfT<false, BLACK>(depth);
 
-            if (result != expected)
+            if (!string_to_count(number, expected) || result != expected)
             {
                 failed = true;
                 std::cout << "ERROR\n" << std::endl;
@@ -87,6 +79,8 @@ void debug()
 
 int main()
 {
+    std::ios::sync_with_stdio(false);
+
     Bitboards::init();
     MoveGen::init();
     
@@ -96,7 +90,9 @@ int main()
 
     do
     {
-        std::getline(std::cin, cmd);
+        if (!std::getline(std::cin, cmd))
+            cmd = "quit";
+
         std::istringstream is(cmd);
         
         is >> token;
@@ -107,18 +103,173 @@ int main()
             is >> depth;
 
             auto start = std::chrono::steady_clock::now();
-            uint64_t result = Position::white_to_move() ? PerfT<true, WHITE>(depth)
-                                                        : PerfT<true, BLACK>(depth);
+            NodeCount result = Position::white_to_move() ? CachedPerfT<true, WHITE>(depth)
+                                                         : CachedPerfT<true, BLACK>(depth);
             auto end   = std::chrono::steady_clock::now();
 
-            std::cout << "\nNodes searched: " << result << "\nIn "
+            std::cout << "\nNodes searched: " << count_to_string(result) << "\nIn "
                       << (std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000) << " ms\n" << std::endl;
         }
         
         else if (token == "position") position(is);
         else if (token == "debug")    debug();
+        else if (token == "cache")
+        {
+            std::string path;
+            size_t      mb = 1024;
+
+            if (is >> path >> mb, path == "off")
+                Cache::close();
+            else if (!Cache::open(path, mb))
+                std::cout << "could not open cache " << path << "\n" << std::endl;
+        }
+        else if (token == "telemetry")
+        {
+            std::string file, shm;
+            int         interval = 1000;
+
+            // telemetry [file <path>] [shm <name>] [interval <ms>], or telemetry off
+
+            while (is >> token)
+                if (token == "file")          is >> file;
+                else if (token == "shm")      is >> shm;
+                else if (token == "interval") is >> interval;
+
+            if (file.empty() && shm.empty())
+                Telemetry::stop();
+            else if (!Telemetry::start(file, shm, interval))
+                std::cout << "could not open shared memory " << shm << "\n" << std::endl;
+        }
+        else if (token == "sliders")
+        {
+            // sliders [pext | hyperbola]
+
+            if (is >> token)
+                hyperbola_sliders = token == "hyperbola" && Hyperbola::supported();
+
+            std::cout << "Slider attacks: " << (hyperbola_sliders ? "hyperbola" : "pext")
+                      << (Hyperbola::supported() ? "" : ", no GFNI on this cpu") << "\n" << std::endl;
+        }
+        else if (token == "batch")
+        {
+            std::string path, out;
+            int         depth = 1;
+
+            is >> path >> depth >> out;
+
+            bool lanes = out == "lanes";
+
+            if (lanes)
+                is >> out;
+
+            Batch::run(path, depth, out, std::max(1u, std::thread::hardware_concurrency()), lanes);
+        }
+        else if (token == "replay")
+        {
+            std::string path, out;
+            int         depth = 0;
+
+            // replay <file> [perft <depth>] [out]
+
+            for (is >> path; is >> token;)
+                if (token == "perft") is >> depth;
+                else                  out = token;
+
+            Batch::replay(path, depth, out, std::max(1u, std::thread::hardware_concurrency()));
+        }
+        else if (token == "serialize")
+        {
+            int depth = 4;
+            is >> depth;
+            Bench::serialize(depth);
+        }
+        else if (token == "export")
+        {
+            std::string path, dedup;
+            int         depth = 1;
+
+            is >> depth >> path >> dedup;
+
+            Packed::export_leaves(depth, path, dedup == "dedup");
+        }
+        else if (token == "import")
+        {
+            std::string path;
+            int         depth = 0;
+
+            is >> path >> depth;
+
+            Packed::import(path, depth);
+        }
+        else if (token == "symperft")
+        {
+            int    depth;
+            size_t mb = 256;
+            bool   prefetch = false;
+
+            is >> depth >> mb;
+
+            // Optional "table <min depth>" and "prefetch" for the interleaved traversal
+
+            for (tt_min_depth = 3; is >> token;)
+                if (token == "table")         is >> tt_min_depth;
+                else if (token == "prefetch") prefetch = true;
+
+            tt_min_depth = std::max(1, tt_min_depth);
+
+            if (!TT::resize(mb))
+            {
+                std::cout << "could not allocate " << mb << " MB\n" << std::endl;
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            NodeCount result = prefetch                  ? Traverse::sym_perft(depth, true)
+                             : Position::white_to_move() ? SymPerfT<true, WHITE>(depth)
+                                                         : SymPerfT<true, BLACK>(depth);
+            auto end   = std::chrono::steady_clock::now();
+
+            std::cout << "\nNodes searched: " << count_to_string(result) << "\nSubtree hits: " << tt_hits << " of " << tt_probes << "\nIn "
+                      << (std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000) << " ms\n" << std::endl;
+        }
+        else if (token == "divide")
+        {
+            int depth = 1;
+            is >> depth;
+            Drill::divide(depth);
+        }
+        else if (token == "enter")    is >> token, Drill::enter(token);
+        else if (token == "up")       Drill::up();
+        else if (token == "compare")  is >> token, Drill::compare(token);
+        else if (token == "estimate")
+        {
+            int         depth   = 1;
+            uint64_t    samples = 100000;
+            double      seconds = 0;
+            std::string mode    = "stratified";
+
+            // estimate <depth> [samples N | time T] [uniform | importance | stratified]
+
+            for (is >> depth; is >> token;)
+                if (token == "samples")   is >> samples, seconds = 0;
+                else if (token == "time") is >> seconds;
+                else                      mode = token;
+
+            Estimate::run(depth, mode, samples, seconds, std::max(1u, std::thread::hardware_concurrency()));
+        }
+        else if (token == "verify")
+        {
+            uint64_t games   = 10000;
+            int      threads = std::max(1u, std::thread::hardware_concurrency());
+
+            is >> games >> threads;
+
+            Verify::run(Position::fen(), games, threads);
+        }
         else if (token == "d")        std::cout << Position::to_string() << std::endl;
-        else if (token == "moves")    for (std::string uci; is >> uci && uci_to_move(uci); Position::commit_move(uci_to_move(uci)));
+        else if (token == "moves")    for (Move m; is >> token && (m = uci_to_move(token)); Position::commit_move(m));
         
     } while (cmd != "quit");
+
+    Telemetry::stop();
 }
@@ -0,0 +1,326 @@
+
+// Kernel micro-benchmarks, built by "make microbench" from the engine sources
+// without main.cpp. Usage: microbench [filter] [runs]
+//
+// Every kernel runs a fixed batch of operations per run over precomputed inputs,
+// and reports the mean ns/op over the runs, their spread and the fastest run.
+// Results are folded into a sink behind an empty asm barrier so the compiler can
+// neither drop the work nor hoist it out of the timed loop
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../bitboard.h"
+#include "../misc.h"
+#include "../movegen.h"
+#include "../moveset.h"
+#include "../position.h"
+
+template<typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Snapshot
+{
+    Bitboard  bitboards[16];
+    Piece     board[SQUARE_NB];
+    StateInfo state;
+
+    static Snapshot take()
+    {
+        Snapshot s;
+        memcpy(s.bitboards, ::bitboards, sizeof(s.bitboards));
+        memcpy(s.board, ::board, sizeof(s.board));
+        s.state = *state_ptr;
+        return s;
+    }
+
+    void restore() const
+    {
+        memcpy(::bitboards, bitboards, sizeof(bitboards));
+        memcpy(::board, board, sizeof(board));
+        state_ptr = state_stack;
+        *state_ptr = state;
+    }
+};
+
+static std::string filter;
+static int         runs = 15;
+
+// Times runs calls of run(), each doing ops operations, after one warm-up call
+
+template<typename F>
+void bench(const char *name, uint64_t ops, F run)
+{
+    if (!ops || !filter.empty() && !strstr(name, filter.c_str()))
+        return;
+
+    std::vector<double> ns;
+
+    run();
+
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+
+        ns.push_back(std::chrono::duration<double, std::nano>(end - start).count() / ops);
+    }
+
+    double mean = 0, var = 0, best = ns[0];
+
+    for (double x : ns) mean += x / ns.size(), best = std::min(best, x);
+    for (double x : ns) var += (x - mean) * (x - mean) / std::max<size_t>(1, ns.size() - 1);
+
+    printf("%-24s %9.2f %14.0f %7.2f %9.2f\n", name, mean, 1e9 / mean, 100 * std::sqrt(var) / mean, best);
+}
+
+// Positions of perft_suite.txt plus every position two plies below them
+
+template<Color Us>
+void collect(std::vector<Snapshot>& out, int depth)
+{
+    out.push_back(Snapshot::take());
+    out.back().state.side_to_move = Us;
+
+    if (depth == 0)
+        return;
+
+    Move list[128], *end = generate_moves<Us>(list);
+
+    for (Move *m = list; m != end; m++)
+    {
+        do_move<Us>(*m);
+        collect<!Us>(out, depth - 1);
+        undo_move<Us>(*m);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Bitboards::init();
+    MoveGen::init();
+
+    if (argc > 1) filter = argv[1];
+    if (argc > 2) runs   = std::max(1, atoi(argv[2]));
+
+    std::vector<std::string> fens;
+    std::ifstream in("perft_suite.txt");
+
+    for (std::string line; std::getline(in, line);)
+        fens.push_back(line.substr(0, line.find(';')));
+
+    if (fens.empty())
+        fens.push_back("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+
+    std::vector<Snapshot> corpus;
+
+    for (const std::string& fen : fens)
+    {
+        Position::set(fen);
+        Position::white_to_move() ? collect<WHITE>(corpus, 2) : collect<BLACK>(corpus, 2);
+    }
+
+    printf("%zu fens, %zu positions, %d runs\n\n", fens.size(), corpus.size(), runs);
+    printf("%-24s %9s %14s %7s %9s\n", "kernel", "ns/op", "ops/s", "+-%", "best ns");
+
+    uint64_t sink = 0;
+
+    // Slider lookups over random squares and sparse random occupancies. Each
+    // occupancy depends on the previous result, so these are latencies
+
+    constexpr int Lookups = 1 << 16;
+
+    struct Lookup { Square sq; Bitboard occupied; };
+    std::vector<Lookup> lookups(Lookups);
+    PRNG rng(0x243f6a8885a308d3ull);
+
+    for (Lookup& l : lookups)
+        l = { Square(rng.below(64)), rng.rand() & rng.rand() & rng.rand() };
+
+    auto slider = [&](const char *name, Bitboard (*f)(Square, Bitboard))
+    {
+        bench(name, Lookups, [&]
+        {
+            for (const Lookup& l : lookups)
+                sink += f(l.sq, l.occupied ^ sink & 1);
+            keep(sink);
+        });
+    };
+
+    slider("bishop_attacks", bishop_attacks);
+    slider("rook_attacks",   rook_attacks);
+    slider("bishop_xray",    bishop_xray);
+    slider("rook_xray",      rook_xray);
+    slider("queen_attacks",  queen_attacks);
+
+    if (Hyperbola::supported())
+    {
+        slider("hyperbola bishop",       Hyperbola::bishop_attacks);
+        slider("hyperbola rook",         Hyperbola::rook_attacks);
+        slider("hyperbola bishop_xray",  Hyperbola::bishop_xray);
+        slider("hyperbola rook_xray",    Hyperbola::rook_xray);
+        slider("hyperbola queen",        Hyperbola::queen_attacks);
+    }
+
+    // Move generation, each position restored once and generated Repeat times
+
+    constexpr int Repeat = 16;
+
+    for (Color us : { WHITE, BLACK })
+    {
+        uint64_t ops = 0;
+
+        for (const Snapshot& s : corpus)
+            ops += (s.state.side_to_move == us) * Repeat;
+
+        bench(us == WHITE ? "generate_moves<WHITE>" : "generate_moves<BLACK>", ops, [&]
+        {
+            Move list[128];
+
+            for (const Snapshot& s : corpus)
+                if (s.state.side_to_move == us)
+                {
+                    s.restore();
+
+                    for (int i = 0; i < Repeat; i++)
+                    {
+                        keep(list);
+                        sink += (us == WHITE ? generate_moves<WHITE>(list) : generate_moves<BLACK>(list)) - list;
+                    }
+                }
+
+            keep(sink);
+        });
+    }
+
+    // The same positions through the MoveSet output and the counting-only output
+
+    for (Color us : { WHITE, BLACK })
+    {
+        uint64_t ops = 0;
+
+        for (const Snapshot& s : corpus)
+            ops += (s.state.side_to_move == us) * Repeat;
+
+        bench(us == WHITE ? "generate_sets<WHITE>" : "generate_sets<BLACK>", ops, [&]
+        {
+            MoveSet sets[MAX_MOVE_SETS];
+
+            for (const Snapshot& s : corpus)
+                if (s.state.side_to_move == us)
+                {
+                    s.restore();
+
+                    for (int i = 0; i < Repeat; i++)
+                    {
+                        keep(sets);
+                        sink += (us == WHITE ? generate_sets<WHITE>(sets) : generate_sets<BLACK>(sets)) - sets;
+                    }
+                }
+
+            keep(sink);
+        });
+
+        bench(us == WHITE ? "count_moves<WHITE>" : "count_moves<BLACK>", ops, [&]
+        {
+            for (const Snapshot& s : corpus)
+                if (s.state.side_to_move == us)
+                {
+                    s.restore();
+
+                    for (int i = 0; i < Repeat; i++)
+                    {
+                        sink += us == WHITE ? count_moves<WHITE>() : count_moves<BLACK>();
+                        keep(sink);
+                    }
+                }
+        });
+    }
+
+    // do_move + undo_move pairs, by the kind of move
+
+    struct Kind { const char *name; std::vector<std::pair<int, Move>> moves; };
+
+    Kind kinds[] = { { "do+undo quiet" }, { "do+undo capture" }, { "do+undo promotion" },
+                     { "do+undo en passant" }, { "do+undo castling" } };
+
+    for (size_t i = 0; i < corpus.size(); i++)
+    {
+        corpus[i].restore();
+
+        Move list[128], *end = corpus[i].state.side_to_move == WHITE ? generate_moves<WHITE>(list) : generate_moves<BLACK>(list);
+
+        for (Move *m = list; m != end; m++)
+        {
+            int k = type_of(*m) == PROMOTION ? 2 : type_of(*m) == ENPASSANT ? 3 : type_of(*m) == CASTLING ? 4
+                  : piece_on(to_sq(*m)) ? 1 : 0;
+
+            kinds[k].moves.emplace_back(i, *m);
+        }
+    }
+
+    for (Kind& kind : kinds)
+        bench(kind.name, kind.moves.size() * Repeat, [&]
+        {
+            int current = -1;
+
+            for (auto [i, m] : kind.moves)
+            {
+                if (i != current)
+                    corpus[current = i].restore();
+
+                for (int r = 0; r < Repeat; r++)
+                {
+                    if (corpus[i].state.side_to_move == WHITE) do_move<WHITE>(m), keep(bitboards), undo_move<WHITE>(m);
+                    else                                       do_move<BLACK>(m), keep(bitboards), undo_move<BLACK>(m);
+                }
+            }
+
+            sink += bitboards[WHITE];
+            keep(sink);
+        });
+
+    // Fen parsing and writing over the suite fens and the whole corpus
+
+    bench("Position::set", fens.size() * Repeat, [&]
+    {
+        for (int r = 0; r < Repeat; r++)
+            for (const std::string& fen : fens)
+            {
+                Position::set(fen.data(), fen.data() + fen.size());
+                sink += bitboards[WHITE];
+            }
+
+        keep(sink);
+    });
+
+    bench("Position::fen(char *)", corpus.size(), [&]
+    {
+        char buf[MAX_FEN_LENGTH];
+
+        for (const Snapshot& s : corpus)
+        {
+            s.restore();
+            sink += Position::fen(buf) - buf;
+            keep(buf);
+        }
+
+        keep(sink);
+    });
+
+    bench("Snapshot restore", corpus.size(), [&]
+    {
+        for (const Snapshot& s : corpus)
+            s.restore(), keep(bitboards);
+    });
+
+    printf("\nsink %llu\n", (unsigned long long)sink);
+}
@@ -0,0 +1,27 @@
+
+#ifndef MISC_H
+#define MISC_H
+
+#include <stdint.h>
+
+// xorshift64* generator, good enough for random games and occupancies
+
+class PRNG
+{
+    uint64_t s;
+
+public:
+    PRNG(uint64_t seed) : s(seed ? seed : 0x9e3779b97f4a7c15ull) {}
+
+    uint64_t rand()
+    {
+        s ^= s >> 12, s ^= s << 25, s ^= s >> 27;
+        return s * 2685821657736338717ull;
+    }
+
+    int below(int n) {
+        return (rand() >> 32) * n >> 32;
+    }
+};
+
+#endif
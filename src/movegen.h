@@ -78,49 +78,129 @@ inline Move *make_moves(Move *list, Square from, Bitboard to)
     return list;
 }
 
+// Everything the legality of the side to move's moves depends on. Computed once,
+// it serves move emission as well as check and pin queries. Pins are left empty
+// in double check, where only the king moves
+
+struct Legality
+{
+    Square   ksq;
+    Bitboard occupied;       // Including our king
+    Bitboard seen_by_enemy;  // Attacked by Them, sliders looking through our king. Lazy: king targets only
+    Bitboard checkers;
+    Bitboard checkmask;      // Squares a non-king move may go to: the check ray, or all but our pieces
+    Bitboard pinned;
+
+    bool in_check()     const { return checkers; }
+    bool double_check() const { return more_than_one(checkers); }
+};
+
+// Both steps are forced inline into generate_moves(list), which then compiles
+// to the same single function as before the split
+
+#define MOVEGEN_INLINE inline __attribute__((always_inline))
+
+// Attack map of Them, or with lazy set only the squares the king may move or
+// castle through, tested one by one. The moves are the same either way, see
+// KING_SAFETY in perft.h for which is faster
+
 template<Color Us>
-Move *generate_moves(Move *list)
+MOVEGEN_INLINE Legality legality(bool lazy = false)
 {
     constexpr Color Them           = !Us;
-    constexpr Piece FriendlyPawn   = make_piece(Us,   PAWN);
     constexpr Piece EnemyPawn      = make_piece(Them, PAWN);
-    constexpr Piece FriendlyKnight = make_piece(Us,   KNIGHT);
     constexpr Piece EnemyKnight    = make_piece(Them, KNIGHT);
-    constexpr Piece FriendlyBishop = make_piece(Us,   BISHOP);
     constexpr Piece EnemyBishop    = make_piece(Them, BISHOP);
-    constexpr Piece FriendlyRook   = make_piece(Us,   ROOK);
     constexpr Piece EnemyRook      = make_piece(Them, ROOK);
-    constexpr Piece FriendlyQueen  = make_piece(Us,   QUEEN);
     constexpr Piece EnemyQueen     = make_piece(Them, QUEEN);
     constexpr Piece FriendlyKing   = make_piece(Us,   KING);
     constexpr Piece EnemyKing      = make_piece(Them, KING);
-    
+
+    Legality l;
+
     Bitboard enemy_rook_queen   = bb(EnemyQueen) | bb(EnemyRook);
     Bitboard enemy_bishop_queen = bb(EnemyQueen) | bb(EnemyBishop);
     Square   ksq                = lsb(bb(FriendlyKing));
     Bitboard occupied           = Position::occupied() ^ bb(FriendlyKing);
-    Bitboard seen_by_enemy      = pawn_attacks<Them>(bb(EnemyPawn)) | king_attacks(lsb(bb(EnemyKing)));
+    Bitboard seen_by_enemy      = 0;
 
-    for (Bitboard b = bb(EnemyKnight);    b; clear_lsb(b)) seen_by_enemy |= knight_attacks(lsb(b));
-    for (Bitboard b = enemy_bishop_queen; b; clear_lsb(b)) seen_by_enemy |= bishop_attacks(lsb(b), occupied);
-    for (Bitboard b = enemy_rook_queen;   b; clear_lsb(b)) seen_by_enemy |= rook_attacks  (lsb(b), occupied);
+    if (lazy)
+    {
+        constexpr Bitboard NoAtk = Us == WHITE ? square_bb(C1, D1, E1, F1, G1) : square_bb(C8, D8, E8, F8, G8);
 
-    toggle_square(occupied, ksq);
+        Bitboard candidates = king_attacks(ksq) & ~bb(Us) | (state_ptr->castling_rights & (Us == WHITE ? 0b1100 : 0b0011) ? NoAtk : 0);
+
+        for (Bitboard b = candidates; b; clear_lsb(b))
+        {
+            Square s = lsb(b);
+
+            if (  knight_attacks(s) & bb(EnemyKnight) | pawn_attacks<Us>(s) & bb(EnemyPawn) | king_attacks(s) & bb(EnemyKing)
+                | bishop_attacks(s, occupied) & enemy_bishop_queen | rook_attacks(s, occupied) & enemy_rook_queen)
+                seen_by_enemy |= square_bb(s);
+        }
+    }
+    else
+    {
+        seen_by_enemy = pawn_attacks<Them>(bb(EnemyPawn)) | king_attacks(lsb(bb(EnemyKing)));
+
+        for (Bitboard b = bb(EnemyKnight);    b; clear_lsb(b)) seen_by_enemy |= knight_attacks(lsb(b));
+        for (Bitboard b = enemy_bishop_queen; b; clear_lsb(b)) seen_by_enemy |= bishop_attacks(lsb(b), occupied);
+        for (Bitboard b = enemy_rook_queen;   b; clear_lsb(b)) seen_by_enemy |= rook_attacks  (lsb(b), occupied);
+    }
 
-    Bitboard checkmask = knight_attacks(ksq) & bb(EnemyKnight) | pawn_attacks<Us>(ksq) & bb(EnemyPawn);
+    toggle_square(occupied, ksq);
 
-    for (Bitboard checkers = bishop_attacks(ksq, occupied) & enemy_bishop_queen | rook_attacks(ksq, occupied) & enemy_rook_queen; checkers; clear_lsb(checkers))
-        checkmask |= check_ray(ksq, lsb(checkers));
+    Bitboard checkers  = knight_attacks(ksq) & bb(EnemyKnight) | pawn_attacks<Us>(ksq) & bb(EnemyPawn);
+    Bitboard checkmask = checkers;
 
-    if (more_than_one(checkmask & double_check(ksq)))
-        return make_moves(list, ksq, king_attacks(ksq) & ~(seen_by_enemy | bb(Us)));
+    for (Bitboard b = bishop_attacks(ksq, occupied) & enemy_bishop_queen | rook_attacks(ksq, occupied) & enemy_rook_queen; b; clear_lsb(b))
+        checkers |= square_bb(lsb(b)), checkmask |= check_ray(ksq, lsb(b));
 
-    checkmask = (checkmask | -!checkmask) & ~bb(Us);
+    l.ksq           = ksq;
+    l.occupied      = occupied;
+    l.seen_by_enemy = seen_by_enemy;
+    l.checkers      = checkers;
+    l.checkmask     = (checkmask | -!checkmask) & ~bb(Us);
+    l.pinned        = 0;
 
-    Bitboard pinned = 0;
+    if (more_than_one(checkers))
+        return l;
 
     for (Bitboard pinners = bishop_xray(ksq, occupied) & enemy_bishop_queen | rook_xray(ksq, occupied) & enemy_rook_queen; pinners; clear_lsb(pinners))
-        pinned |= check_ray(ksq, lsb(pinners));
+        l.pinned |= check_ray(ksq, lsb(pinners));
+
+    return l;
+}
+
+// Emits the legal moves of the position l was computed for, in a fixed order,
+// as target sets to out:
+//   out.pawns<Type, D>(to)   pawn moves to every square of to, from to - D
+//   out.piece(from, to)      moves from one square to every square of to
+//   out.single(m, legal)     one move, dropped unless legal
+
+template<Color Us, typename Out>
+MOVEGEN_INLINE void emit_moves(Out& out, const Legality& l)
+{
+    constexpr Color Them           = !Us;
+    constexpr Piece FriendlyPawn   = make_piece(Us,   PAWN);
+    constexpr Piece FriendlyKnight = make_piece(Us,   KNIGHT);
+    constexpr Piece FriendlyBishop = make_piece(Us,   BISHOP);
+    constexpr Piece EnemyBishop    = make_piece(Them, BISHOP);
+    constexpr Piece FriendlyRook   = make_piece(Us,   ROOK);
+    constexpr Piece EnemyRook      = make_piece(Them, ROOK);
+    constexpr Piece FriendlyQueen  = make_piece(Us,   QUEEN);
+    constexpr Piece EnemyQueen     = make_piece(Them, QUEEN);
+
+    Bitboard enemy_rook_queen   = bb(EnemyQueen) | bb(EnemyRook);
+    Bitboard enemy_bishop_queen = bb(EnemyQueen) | bb(EnemyBishop);
+    Square   ksq                = l.ksq;
+    Bitboard occupied           = l.occupied;
+    Bitboard seen_by_enemy      = l.seen_by_enemy;
+    Bitboard checkmask          = l.checkmask;
+    Bitboard pinned             = l.pinned;
+
+    if (l.double_check())
+        return out.piece(ksq, king_attacks(ksq) & ~(seen_by_enemy | bb(Us)));
 
     constexpr Direction Up      = Us == WHITE ? NORTH      : SOUTH;
     constexpr Direction Up2     = Us == WHITE ? NORTH * 2  : SOUTH * 2;
@@ -134,35 +214,35 @@ Move *generate_moves(Move *list)
     Bitboard empty = ~occupied;
     Bitboard e     = shift<Up>(Rank3 & empty) & empty;
 
-    list = make_pawn_moves<NORMAL, UpRight>(list, shift<UpRight>(pawns & (~pinned | anti_diag(ksq))) & bb(Them) & checkmask);
-    list = make_pawn_moves<NORMAL, UpLeft >(list, shift<UpLeft >(pawns & (~pinned | main_diag(ksq))) & bb(Them) & checkmask);
-    list = make_pawn_moves<NORMAL, Up     >(list, shift<Up     >(pawns & (~pinned | file_bb  (ksq))) & empty    & checkmask);
-    list = make_pawn_moves<NORMAL, Up2    >(list, shift<Up2    >(pawns & (~pinned | file_bb  (ksq))) & e        & checkmask);
+    out.template pawns<NORMAL, UpRight>(shift<UpRight>(pawns & (~pinned | anti_diag(ksq))) & bb(Them) & checkmask);
+    out.template pawns<NORMAL, UpLeft >(shift<UpLeft >(pawns & (~pinned | main_diag(ksq))) & bb(Them) & checkmask);
+    out.template pawns<NORMAL, Up     >(shift<Up     >(pawns & (~pinned | file_bb  (ksq))) & empty    & checkmask);
+    out.template pawns<NORMAL, Up2    >(shift<Up2    >(pawns & (~pinned | file_bb  (ksq))) & e        & checkmask);
 
     if (Bitboard promotable = bb(FriendlyPawn) & Rank7)
     {
-        list = make_pawn_moves<PROMOTION, UpRight>(list, shift<UpRight>(promotable & (~pinned | anti_diag(ksq))) & bb(Them) & checkmask);
-        list = make_pawn_moves<PROMOTION, UpLeft >(list, shift<UpLeft >(promotable & (~pinned | main_diag(ksq))) & bb(Them) & checkmask);
-        list = make_pawn_moves<PROMOTION, Up     >(list, shift<Up     >(promotable &  ~pinned                  ) & empty    & checkmask);
+        out.template pawns<PROMOTION, UpRight>(shift<UpRight>(promotable & (~pinned | anti_diag(ksq))) & bb(Them) & checkmask);
+        out.template pawns<PROMOTION, UpLeft >(shift<UpLeft >(promotable & (~pinned | main_diag(ksq))) & bb(Them) & checkmask);
+        out.template pawns<PROMOTION, Up     >(shift<Up     >(promotable &  ~pinned                  ) & empty    & checkmask);
     }
  
     if (shift<UpRight>(bb(FriendlyPawn)) & Position::ep_bb() & Rank6)
     {
-        *list = make_move<ENPASSANT>(state_ptr->ep_sq - UpRight, state_ptr->ep_sq);
         Bitboard after_ep = occupied ^ square_bb(state_ptr->ep_sq - UpRight, state_ptr->ep_sq - Up, state_ptr->ep_sq);
-        list += !(bishop_attacks(ksq, after_ep) & enemy_bishop_queen | rook_attacks(ksq, after_ep) & enemy_rook_queen);
+        out.single(make_move<ENPASSANT>(state_ptr->ep_sq - UpRight, state_ptr->ep_sq),
+                   !(bishop_attacks(ksq, after_ep) & enemy_bishop_queen | rook_attacks(ksq, after_ep) & enemy_rook_queen));
     }
     if (shift<UpLeft>(bb(FriendlyPawn)) & Position::ep_bb() & Rank6)
     {
-        *list = make_move<ENPASSANT>(state_ptr->ep_sq - UpLeft, state_ptr->ep_sq);
         Bitboard after_ep = occupied ^ square_bb(state_ptr->ep_sq - UpLeft, state_ptr->ep_sq - Up, state_ptr->ep_sq);
-        list += !(bishop_attacks(ksq, after_ep) & enemy_bishop_queen | rook_attacks(ksq, after_ep) & enemy_rook_queen);
+        out.single(make_move<ENPASSANT>(state_ptr->ep_sq - UpLeft, state_ptr->ep_sq),
+                   !(bishop_attacks(ksq, after_ep) & enemy_bishop_queen | rook_attacks(ksq, after_ep) & enemy_rook_queen));
     }
 
     for (Bitboard b = bb(FriendlyKnight) & ~pinned; b; clear_lsb(b))
     {
         Square from = lsb(b);
-        list = make_moves(list, from, knight_attacks(from) & checkmask);
+        out.piece(from, knight_attacks(from) & checkmask);
     }
 
     Bitboard bishop_queen = bb(FriendlyBishop) | bb(FriendlyQueen);
@@ -171,34 +251,59 @@ Move *generate_moves(Move *list)
     for (Bitboard b = bishop_queen & ~pinned; b; clear_lsb(b))
     {
         Square from = lsb(b);
-        list = make_moves(list, from, bishop_attacks(from, occupied) & checkmask);
+        out.piece(from, bishop_attacks(from, occupied) & checkmask);
     }
     for (Bitboard b = bishop_queen & pinned; b; clear_lsb(b))
     {
         Square from = lsb(b);
-        list = make_moves(list, from, bishop_attacks(from, occupied) & checkmask & align_mask(ksq, from));
+        out.piece(from, bishop_attacks(from, occupied) & checkmask & align_mask(ksq, from));
     }
     for (Bitboard b = rook_queen & ~pinned; b; clear_lsb(b))
     {
         Square from = lsb(b);
-        list = make_moves(list, from, rook_attacks(from, occupied) & checkmask);
+        out.piece(from, rook_attacks(from, occupied) & checkmask);
     }
     for (Bitboard b = rook_queen & pinned; b; clear_lsb(b))
     {
         Square from = lsb(b);
-        list = make_moves(list, from, rook_attacks(from, occupied) & checkmask & align_mask(ksq, from));
+        out.piece(from, rook_attacks(from, occupied) & checkmask & align_mask(ksq, from));
     }
 
-    list = make_moves(list, ksq, king_attacks(ksq) & ~(seen_by_enemy | bb(Us)));
+    out.piece(ksq, king_attacks(ksq) & ~(seen_by_enemy | bb(Us)));
 
     constexpr int Shift = Us == WHITE ? 1 : 57;
 
     constexpr Bitboard NoAtk = Us == WHITE ? square_bb(C1, D1, E1, F1, G1) : square_bb(C8, D8, E8, F8, G8);
     constexpr Bitboard NoOcc = Us == WHITE ? square_bb(B1, C1, D1, F1, G1) : square_bb(B8, C8, D8, F8, G8);
 
-    for (Move *src = table[Us][state_ptr->castling_rights][(NoAtk & seen_by_enemy | NoOcc & occupied) >> Shift]; *src; *list++ = *src++);
+    for (Move *src = table[Us][state_ptr->castling_rights][(NoAtk & seen_by_enemy | NoOcc & occupied) >> Shift]; *src; src++)
+        out.single(*src, true);
+}
+
+// emit_moves() output as a plain Move array
 
-    return list;
+struct MoveList
+{
+    Move *list;
+
+    template<MoveType Type, Direction D>
+    void pawns(Bitboard to) { list = make_pawn_moves<Type, D>(list, to); }
+
+    void piece(Square from, Bitboard to) { list = make_moves(list, from, to); }
+    void single(Move m, bool legal)      { *list = m, list += legal; }
+};
+
+template<Color Us>
+MOVEGEN_INLINE Move *generate_moves(Move *list, const Legality& l)
+{
+    MoveList out = { list };
+    emit_moves<Us>(out, l);
+    return out.list;
+}
+
+template<Color Us>
+Move *generate_moves(Move *list) {
+    return generate_moves<Us>(list, legality<Us>());
 }
 
 #endif
@@ -0,0 +1,110 @@
+
+#ifndef MOVESET_H
+#define MOVESET_H
+
+#include "movegen.h"
+#include "types.h"
+
+// Compact generator output: one entry per target set emit_moves() produces
+// rather than one Move per target. The move to a target square is
+// base + to * stride, which folds both the fixed from square of a piece
+// (stride 1) and the from = to - D of a pawn set (stride 65) into one formula.
+// Promotion sets stand for the four moves N, B, R, Q per target
+
+struct MoveSet
+{
+    Bitboard targets;
+    Move     base;
+    uint8_t  stride;
+    uint8_t  promotion;  // log2 of the moves per target, 0 or 2
+};
+
+// Only sets with targets are kept: one per knight, bishop and rook, two per
+// queen (its diagonal and straight lines go out separately), one for the king,
+// two castlings and up to 9 pawn sets (4 pushes and captures, 3 promotions,
+// 2 en passant). With p pawns there are at most 9 - p queens and 15 - p pieces
+// besides the king, so pieces give at most 24 - 2p sets, while pawns give at
+// most 4, 7, 8 and 9 sets for p = 1 to 4. The total peaks at 30 with two pawns,
+// and one more entry is written past the last kept one
+
+constexpr int MAX_MOVE_SETS = 32;
+
+// emit_moves() output as MoveSets. Entries with no targets are overwritten
+
+struct MoveSetList
+{
+    MoveSet *sets;
+
+    template<MoveType Type, Direction D>
+    void pawns(Bitboard to)
+    {
+        *sets = { to, Move((Type == PROMOTION ? KNIGHT_PROMOTION : 0) - D * 64), 65, Type == PROMOTION ? 2 : 0 };
+        sets += bool(to);
+    }
+
+    void piece(Square from, Bitboard to)
+    {
+        *sets = { to, Move(from << 6), 1, 0 };
+        sets += bool(to);
+    }
+
+    void single(Move m, bool legal)
+    {
+        *sets = { square_bb(to_sq(m)), Move(m - to_sq(m)), 1, 0 };
+        sets += legal;
+    }
+};
+
+// emit_moves() output reduced to the number of moves, without any writes
+
+struct MoveCounter
+{
+    uint64_t count = 0;
+
+    template<MoveType Type, Direction D>
+    void pawns(Bitboard to) { count += popcount(to) << (Type == PROMOTION ? 2 : 0); }
+
+    void piece(Square, Bitboard to) { count += popcount(to); }
+    void single(Move, bool legal)   { count += legal; }
+};
+
+template<Color Us>
+MOVEGEN_INLINE MoveSet *generate_sets(MoveSet *sets, const Legality& l)
+{
+    MoveSetList out = { sets };
+    emit_moves<Us>(out, l);
+    return out.sets;
+}
+
+template<Color Us>
+MoveSet *generate_sets(MoveSet *sets) {
+    return generate_sets<Us>(sets, legality<Us>());
+}
+
+template<Color Us>
+uint64_t count_moves(bool lazy = false)
+{
+    MoveCounter out;
+    emit_moves<Us>(out, legality<Us>(lazy));
+    return out.count;
+}
+
+// Decodes the moves of [begin, end) one at a time, in the order generate_moves()
+// lists them, and calls f(move) on each
+
+template<typename F>
+void for_each_move(const MoveSet *begin, const MoveSet *end, F f)
+{
+    for (const MoveSet *s = begin; s != end; s++)
+        for (Bitboard b = s->targets; b; clear_lsb(b))
+        {
+            Move m = s->base + lsb(b) * s->stride;
+
+            f(m);
+
+            if (s->promotion)
+                f(Move(m + (1 << 14))), f(Move(m + (2 << 14))), f(Move(m + (3 << 14)));
+        }
+}
+
+#endif
@@ -0,0 +1,288 @@
+
+#include "packed.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+#include "movegen.h"
+#include "perft.h"
+#include "position.h"
+#include "uci.h"
+
+PackedPosition Packed::pack(Color side_to_move)
+{
+    PackedPosition p = {};
+
+    p.occupied = Position::occupied();
+    p.state    = side_to_move | state_ptr->castling_rights << 1;
+    p.ep_sq    = state_ptr->ep_sq;
+
+    int i = 0;
+
+    for (Bitboard b = p.occupied; b; clear_lsb(b), i++)
+        p.pieces[i / 2] |= board[lsb(b)] << 4 * (i & 1);
+
+    return p;
+}
+
+void Packed::unpack(const PackedPosition& p)
+{
+    state_ptr = state_stack;
+
+    memset(board, NO_PIECE, sizeof(board));
+    memset(bitboards, 0ull, sizeof(bitboards));
+
+    int i = 0;
+
+    for (Bitboard b = p.occupied; b; clear_lsb(b), i++)
+    {
+        Square s  = lsb(b);
+        Piece  pc = p.pieces[i / 2] >> 4 * (i & 1) & 0xf;
+
+        board[s] = pc;
+        bitboards[pc] |= square_bb(s);
+        bitboards[color_of(pc)] |= square_bb(s);
+    }
+
+    state_ptr->side_to_move    = p.state & 1;
+    state_ptr->castling_rights = p.state >> 1;
+    state_ptr->ep_sq           = p.ep_sq;
+}
+
+// Appends records through a large aligned buffer. The file is opened with
+// O_DIRECT when the filesystem allows it, in which case the tail block is
+// zero padded on close and the file truncated back to the real length. The
+// first failed write or truncate is kept in error, later appends are dropped
+
+class Writer
+{
+    static constexpr size_t BufferSize = 4 << 20;
+
+    int      fd;
+    bool     direct;
+    char    *buffer;
+    size_t   used    = 0;
+    uint64_t written = 0;
+    int      error   = 0;
+
+    void write_out(size_t n)
+    {
+        for (size_t done = 0; done < n;)
+        {
+            ssize_t r = ::write(fd, buffer + done, n - done);
+
+            if (r < 0 && errno == EINVAL && direct)
+            {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+                direct = false;
+                continue;
+            }
+
+            if (r <= 0)
+            {
+                error = r < 0 ? errno : ENOSPC;
+                return;
+            }
+
+            done += r;
+        }
+    }
+
+public:
+    explicit Writer(const std::string& path)
+    {
+        fd     = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        direct = fd >= 0;
+
+        if (!direct)
+            fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        buffer = (char *)aligned_alloc(4096, BufferSize);
+        error  = fd < 0 ? errno : buffer ? 0 : ENOMEM;
+    }
+
+    ~Writer()
+    {
+        close();
+        free(buffer);
+    }
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // Writes out the tail and closes the file. Returns 0 or the first error
+
+    int close()
+    {
+        if (fd >= 0)
+        {
+            size_t padded = direct ? (used + 4095) & ~size_t(4095) : used;
+
+            if (!error)
+            {
+                memset(buffer + used, 0, padded - used);
+                write_out(padded);
+            }
+
+            if (!error && ftruncate(fd, written + used))
+                error = errno;
+
+            if (::close(fd) && !error)
+                error = errno;
+
+            fd = -1;
+        }
+
+        return error;
+    }
+
+    int status() const {
+        return error;
+    }
+
+    void append(const PackedPosition& p)
+    {
+        if (error)
+            return;
+
+        if (used == BufferSize)
+        {
+            write_out(used);
+            written += used, used = 0;
+        }
+
+        memcpy(buffer + used, &p, sizeof(p));
+        used += sizeof(p);
+    }
+};
+
+template<Color Us>
+void walk(int depth, Writer& out, std::unordered_set<uint64_t> *seen, uint64_t& leaves, uint64_t& records)
+{
+    if (depth == 0)
+    {
+        leaves++;
+
+        if (!seen || seen->insert(Position::key(Us)).second)
+            out.append(Packed::pack(Us)), records++;
+
+        return;
+    }
+
+    Move list[128], *end = generate_moves<Us>(list);
+
+    for (Move *m = list; m != end; m++)
+    {
+        do_move<Us>(*m);
+        walk<!Us>(depth - 1, out, seen, leaves, records);
+        undo_move<Us>(*m);
+    }
+}
+
+void Packed::export_leaves(int depth, const std::string& path, bool dedup)
+{
+    uint64_t leaves = 0, records = 0;
+    std::unordered_set<uint64_t> seen;
+
+    auto start = std::chrono::steady_clock::now();
+
+    Writer out(path);
+
+    if (!out.status())
+    {
+        if (Position::white_to_move()) walk<WHITE>(depth, out, dedup ? &seen : nullptr, leaves, records);
+        else                           walk<BLACK>(depth, out, dedup ? &seen : nullptr, leaves, records);
+    }
+
+    if (int error = out.close())
+    {
+        std::cout << "could not write " << path << ": " << strerror(error) << "\n" << std::endl;
+        return;
+    }
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "\nLeaves: " << leaves << "\nRecords written: " << records
+              << " (" << records * sizeof(PackedPosition) / (1 << 20) << " MB)"
+              << "\nIn " << ms << " ms (" << records * 1000 / (ms + 1) << " records/s)\n" << std::endl;
+}
+
+Packed::Reader::Reader(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd < 0)
+        return;
+
+    if (fstat(fd, &st) == 0 && st.st_size >= sizeof(PackedPosition))
+    {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (p != MAP_FAILED)
+        {
+            records = (const PackedPosition *)p;
+            count   = st.st_size / sizeof(PackedPosition);
+        }
+    }
+
+    close(fd);
+}
+
+Packed::Reader::~Reader()
+{
+    if (records)
+        munmap((void *)records, count * sizeof(PackedPosition));
+}
+
+// Loads every record, checks that packing it again gives the same bytes and,
+// with depth > 0, sums the perft counts below the records
+
+void Packed::import(const std::string& path, int depth)
+{
+    Reader in(path);
+
+    if (!in.size())
+    {
+        std::cout << "could not read " << path << "\n" << std::endl;
+        return;
+    }
+
+    std::string fen = Position::fen();
+    uint64_t    mismatches = 0;
+    NodeCount   nodes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        in.load(i);
+
+        Color us = Position::white_to_move() ? WHITE : BLACK;
+        PackedPosition p = pack(us);
+
+        mismatches += memcmp(&p, &in[i], sizeof(p)) != 0;
+
+        if (depth > 0)
+            nodes += us == WHITE ? PerfT<false, WHITE>(depth) : PerfT<false, BLACK>(depth);
+    }
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    Position::set(fen);
+
+    std::cout << "\nRecords read: " << in.size() << "\nRound trip mismatches: " << mismatches;
+
+    if (depth > 0)
+        std::cout << "\nNodes searched: " << count_to_string(nodes);
+
+    std::cout << "\nIn " << ms << " ms (" << in.size() * 1000 / (ms + 1) << " records/s)\n" << std::endl;
+}
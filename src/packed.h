@@ -0,0 +1,55 @@
+
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <string>
+
+#include "types.h"
+
+// Fixed-size 32 byte position record. Piece codes are stored as nibbles in the
+// order of the occupied bits, least significant square first
+
+struct PackedPosition
+{
+    Bitboard occupied;
+    uint8_t  pieces[16];
+    uint8_t  state;      // side_to_move | castling_rights << 1
+    uint8_t  ep_sq;
+    uint8_t  reserved[6];
+};
+
+static_assert(sizeof(PackedPosition) == 32, "PackedPosition must stay 32 bytes");
+
+namespace Packed
+{
+    PackedPosition pack(Color side_to_move);
+    void unpack(const PackedPosition& p);
+
+    // Writes every leaf at depth below the current position to path, optionally
+    // skipping positions whose key was already written
+    void export_leaves(int depth, const std::string& path, bool dedup);
+
+    // Reads an exported file back, see packed.cpp
+    void import(const std::string& path, int depth);
+
+    // Read-only mapping of an exported file. Empty when the file can't be mapped
+    class Reader
+    {
+        const PackedPosition *records = nullptr;
+        size_t                count   = 0;
+
+    public:
+        explicit Reader(const std::string& path);
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        size_t size() const { return count; }
+        const PackedPosition& operator[](size_t i) const { return records[i]; }
+
+        void load(size_t i) const { unpack(records[i]); }
+    };
+}
+
+#endif
@@ -0,0 +1,249 @@
+
+#ifndef PERFT_H
+#define PERFT_H
+
+#include <iostream>
+
+#include "cache.h"
+#include "movegen.h"
+#include "moveset.h"
+#include "position.h"
+#include "telemetry.h"
+#include "tt.h"
+#include "types.h"
+#include "uci.h"
+
+// The last UNROLLED_PLIES plies are instantiated once per remaining depth, so
+// the leaf plies carry no depth tests and each level is compiled on its own.
+// 0 turns the unrolling off
+
+#ifndef UNROLLED_PLIES
+#define UNROLLED_PLIES 3
+#endif
+
+constexpr int UnrolledPlies = UNROLLED_PLIES;
+
+// With MOVE_SETS the unrolled plies walk MoveSets instead of Move arrays, and
+// the last one counts target sets without writing any moves
+
+#ifndef MOVE_SETS
+#define MOVE_SETS 1
+#endif
+
+constexpr bool UseMoveSets = MOVE_SETS;
+
+// How the perft kernels learn which squares Them attacks: 0 the full attack
+// map, 1 lazy tests of the king's target squares only. Only the king and
+// castling moves depend on it. A lazy test costs about two slider lookups per
+// king target, the map one lookup per enemy piece, yet the map was as fast or
+// faster on every suite position timed, boxed-in kings in the opening included
+
+#ifndef KING_SAFETY
+#define KING_SAFETY 0
+#endif
+
+constexpr bool LazyKingSafety = KING_SAFETY != 0;
+
+template<int Depth, Color SideToMove>
+uint64_t UnrolledPerfT()
+{
+    if constexpr (Depth == 0)
+        return 1;
+    else if constexpr (UseMoveSets)
+    {
+        if constexpr (Depth == 1)
+            return count_moves<SideToMove>(LazyKingSafety);
+        else
+        {
+            MoveSet sets[MAX_MOVE_SETS], *end = generate_sets<SideToMove>(sets, legality<SideToMove>(LazyKingSafety));
+            uint64_t nodes = 0;
+
+            for_each_move(sets, end, [&](Move m)
+            {
+                do_move<SideToMove>(m);
+                nodes += UnrolledPerfT<Depth - 1, !SideToMove>();
+                undo_move<SideToMove>(m);
+            });
+
+            return nodes;
+        }
+    }
+    else
+    {
+        Move list[128], *end = generate_moves<SideToMove>(list, legality<SideToMove>(LazyKingSafety));
+
+        if constexpr (Depth == 1)
+            return end - list;
+        else
+        {
+            uint64_t nodes = 0;
+
+            for (Move *m = list; m != end; m++)
+            {
+                do_move<SideToMove>(*m);
+                nodes += UnrolledPerfT<Depth - 1, !SideToMove>();
+                undo_move<SideToMove>(*m);
+            }
+
+            return nodes;
+        }
+    }
+}
+
+// Hands a runtime depth of at most UnrolledPlies to its instantiation
+
+template<Color SideToMove, int Depth = UnrolledPlies>
+uint64_t UnrolledPerfT(int depth)
+{
+    if constexpr (Depth == 0)
+        return 1;
+    else
+        return depth == Depth ? UnrolledPerfT<Depth, SideToMove>() : UnrolledPerfT<SideToMove, Depth - 1>(depth);
+}
+
+// Below NarrowDepth plies no position has 2^64 leaves (218^8 < 2^64), so the
+// plies near the leaves count in 64 bits and only the sums above are widened
+
+constexpr int NarrowDepth = 8;
+
+// Telemetry is fed once per unrolled subtree, far from the per node work
+
+template<Color SideToMove>
+uint64_t NarrowPerfT(int depth)
+{
+    if (depth <= UnrolledPlies)
+    {
+        uint64_t nodes = UnrolledPerfT<SideToMove>(depth);
+        Telemetry::nodes(nodes);
+        return nodes;
+    }
+
+    Move list[128], *end = generate_moves<SideToMove>(list);
+
+    if (depth == 1)
+        return Telemetry::nodes(end - list), end - list;
+
+    uint64_t nodes = 0;
+
+    for (Move *m = list; m != end; m++)
+    {
+        do_move<SideToMove>(*m);
+        nodes += NarrowPerfT<!SideToMove>(depth - 1);
+        undo_move<SideToMove>(*m);
+    }
+
+    return nodes;
+}
+
+template<bool Root, Color SideToMove>
+NodeCount PerfT(int depth)
+{
+    if (depth <= NarrowDepth && !Root)
+        return NarrowPerfT<SideToMove>(depth);
+
+    if (depth == 0)
+        return 1;
+
+    Move list[128], *end = generate_moves<SideToMove>(list);
+
+    NodeCount count, nodes = 0;
+
+    for (Move *m = list; m != end; m++)
+    {
+        do_move<SideToMove>(*m);
+        count = PerfT<false, !SideToMove>(depth - 1);
+        undo_move<SideToMove>(*m);
+
+        nodes += count;
+
+        if (Root)
+        {
+            char line[48];
+            std::cout.write(line, divide_line(*m, count, line) - line);
+            Telemetry::progress(m - list + 1, end - list);
+        }
+    }
+
+    return nodes;
+}
+
+// PerfT() behind the persistent cache. With Root set every root move is looked
+// up on its own, so a divide is answered from the cache as well
+
+template<bool Root, Color SideToMove>
+NodeCount CachedPerfT(int depth)
+{
+    if (!Cache::enabled() || depth == 0)
+        return PerfT<Root, SideToMove>(depth);
+
+    uint64_t  key   = Position::key(SideToMove);
+    NodeCount nodes = 0;
+
+    if (!Root && Cache::probe(key, depth, nodes))
+        return nodes;
+
+    if (!Root)
+        nodes = PerfT<false, SideToMove>(depth);
+    else
+    {
+        Move list[128], *end = generate_moves<SideToMove>(list);
+
+        for (Move *m = list; m != end; m++)
+        {
+            do_move<SideToMove>(*m);
+            NodeCount count = CachedPerfT<false, !SideToMove>(depth - 1);
+            undo_move<SideToMove>(*m);
+
+            nodes += count;
+
+            char line[48];
+            std::cout.write(line, divide_line(*m, count, line) - line);
+            Telemetry::progress(m - list + 1, end - list);
+        }
+    }
+
+    Cache::store(key, depth, nodes);
+
+    return nodes;
+}
+
+// PerfT() over the subtree table, keyed by Position::canonical_key() so that
+// transpositions and color-flipped or mirrored twins are searched once. Mirrored
+// root moves of a symmetric root are answered from the table as well
+
+template<bool Root, Color SideToMove>
+NodeCount SymPerfT(int depth)
+{
+    if (depth == 0 || depth < tt_min_depth && !Root)
+        return PerfT<false, SideToMove>(depth);
+
+    uint64_t  key   = Position::canonical_key(SideToMove);
+    NodeCount nodes = 0;
+
+    if (!Root && TT::probe(key, depth, nodes))
+        return nodes;
+
+    Move list[128], *end = generate_moves<SideToMove>(list);
+
+    for (Move *m = list; m != end; m++)
+    {
+        do_move<SideToMove>(*m);
+        NodeCount count = SymPerfT<false, !SideToMove>(depth - 1);
+        undo_move<SideToMove>(*m);
+
+        nodes += count;
+
+        if (Root)
+        {
+            char line[48];
+            std::cout.write(line, divide_line(*m, count, line) - line);
+            Telemetry::progress(m - list + 1, end - list);
+        }
+    }
+
+    TT::store(key, depth, nodes);
+
+    return nodes;
+}
+
+#endif
@@ -1,53 +1,111 @@
 
 #include "position.h"
 
+#include <algorithm>
 #include <cstring>
 #include <sstream>
 
 #include "bitboard.h"
+#include "movegen.h"
 #include "uci.h"
 
-Bitboard bitboards[16];
-Piece board[SQUARE_NB];
+constexpr char piece_to_char[] = "  PNBRQK  pnbrqk";
 
-StateInfo state_stack[MAX_PLY], *state_ptr = state_stack;
+// Character lookups for the fen parser, so parsing is a single pass without
+// searches into piece_to_char or any allocation
 
-std::string piece_to_char = "  PNBRQK  pnbrqk";
+struct FenTables
+{
+    Piece   piece[256];
+    uint8_t castling[256];
+};
+
+static constexpr FenTables make_fen_tables()
+{
+    FenTables t = {};
+
+    for (int i = 2; i < 16; i++)
+        if (piece_to_char[i] != ' ')
+            t.piece[(unsigned char)piece_to_char[i]] = i;
+
+    t.castling['q'] = 1, t.castling['k'] = 2, t.castling['Q'] = 4, t.castling['K'] = 8;
+
+    return t;
+}
+
+static constexpr FenTables Fen = make_fen_tables();
+
+const char *Position::set(const char *fen, const char *end)
+{
+    state_ptr = state_stack;
 
-void Position::set(const std::string& fen)
-{    
     memset(board, NO_PIECE, sizeof(board));
     memset(bitboards, 0ull, sizeof(bitboards));
 
-    Square             sq = A8;
-    std::istringstream is(fen);
-    std::string        pieces, color, castling, enpassant;
+    const char *p = fen;
+    Square     sq = A8;
 
-    is >> pieces >> color >> castling >> enpassant;
+    auto skip_spaces = [&] { while (p < end && *p == ' ') p++; };
 
-    for (char token : pieces)
+    skip_spaces();
+
+    // Eight ranks of eight squares each, or the fen is rejected
+
+    for (int rank = 0, file = 0; ; p++)
     {
-        if (std::isdigit(token))
-            sq -= token - '0'; 
-        else if (size_t piece = piece_to_char.find(token); piece != std::string::npos)
+        if (p == end || *p == ' ')
+        {
+            if (rank != 7 || file != 8)
+                return nullptr;
+
+            break;
+        }
+
+        if (*p == '/' && file == 8 && rank < 7)
+            rank++, file = 0;
+        else if (unsigned digit = *p - '0'; digit >= 1 && digit <= 8 - file)
+            sq -= digit, file += digit;
+        else if (Piece pc = Fen.piece[(unsigned char)*p]; pc && file < 8)
         {
-            board[sq] = piece;
-            bitboards[piece] |= square_bb(sq);
-            bitboards[color_of(piece)] |= square_bb(sq);
-            sq--;
+            board[sq] = pc;
+            bitboards[pc] |= square_bb(sq);
+            bitboards[color_of(pc)] |= square_bb(sq);
+            sq--, file++;
         }
+        else
+            return nullptr;
     }
 
-    state_ptr->side_to_move = color == "w" ? WHITE : BLACK;
+    // Move generation takes the king square from lsb(), so each side needs one
+
+    if (popcount(bitboards[W_KING]) != 1 || popcount(bitboards[B_KING]) != 1)
+        return nullptr;
+
+    skip_spaces();
+
+    state_ptr->side_to_move = p < end && *p == 'w' ? WHITE : BLACK;
+
+    for (; p < end && *p != ' '; p++);
+
+    skip_spaces();
 
     state_ptr->castling_rights = state_ptr->ep_sq = 0;
 
-    for (char token : castling)
-        if (size_t idx = std::string("qkQK").find(token); idx != std::string::npos)
-            state_ptr->castling_rights |= 1 << idx;
+    for (; p < end && *p != ' '; p++)
+        state_ptr->castling_rights |= Fen.castling[(unsigned char)*p];
+
+    skip_spaces();
+
+    if (end - p >= 2 && *p != '-')
+        state_ptr->ep_sq = 8 * (p[1] - '1') + 'h' - p[0];
+
+    for (; p < end && *p != ' '; p++);
+
+    return p;
+}
 
-    if (enpassant != "-")
-        state_ptr->ep_sq = uci_to_square(enpassant);
+bool Position::set(const std::string& fen) {
+    return set(fen.data(), fen.data() + fen.size());
 }
 
 std::string Position::to_string()
@@ -64,51 +122,156 @@ std::string Position::to_string()
             ss << "| " << (sq / 8 + 1) << "\n+---+---+---+---+---+---+---+---+\n";
     }
 
-    return ss.str() + "  a   b   c   d   e   f   g   h\n\n" + fen() + "\n";
+    ss << "  a   b   c   d   e   f   g   h\n\n" << fen() << "\n";
+
+    Legality l = white_to_move() ? legality<WHITE>() : legality<BLACK>();
+
+    if (l.in_check())
+    {
+        ss << "Checkers:";
+
+        for (Bitboard b = l.checkers; b; clear_lsb(b))
+            ss << " " << square_to_uci(lsb(b));
+
+        ss << "\n";
+    }
+
+    return ss.str();
 }
 
-std::string Position::fen()
+char *Position::fen(char *buf)
 {
-    std::stringstream fen;
+    char *p     = buf;
+    int   empty = 0;
 
-    for (int rank = 7; rank >= 0; rank--)
+    for (Square sq = A8; sq >= H1; sq--)
     {
-        for (int file = 7; file >= 0; file--)
+        if (Piece pc = board[sq])
         {
-            if (Piece pc = piece_on(rank * 8 + file))
-                fen << piece_to_char[pc];
-            else
-            {
-                int empty = 0, f;
+            if (empty)
+                *p++ = '0' + empty, empty = 0;
 
-                for (f = file; f >= 0 && !piece_on(rank * 8 + f); f--)
-                    empty++;
+            *p++ = piece_to_char[pc];
+        }
+        else
+            empty++;
 
-                fen << empty;
+        if (sq % 8 == 0)
+        {
+            if (empty)
+                *p++ = '0' + empty, empty = 0;
 
-                file = f + 1;
-            }
+            *p++ = sq ? '/' : ' ';
         }
-
-        if (rank)
-            fen << "/";
     }
 
-    fen << " " << "wb"[state_ptr->side_to_move] << " ";
+    *p++ = "wb"[state_ptr->side_to_move];
+    *p++ = ' ';
 
     if (!state_ptr->castling_rights)
-        fen << "-";
+        *p++ = '-';
+    else
+    {
+        if (state_ptr->castling_rights & 0b1000) *p++ = 'K';
+        if (state_ptr->castling_rights & 0b0100) *p++ = 'Q';
+        if (state_ptr->castling_rights & 0b0010) *p++ = 'k';
+        if (state_ptr->castling_rights & 0b0001) *p++ = 'q';
+    }
+
+    *p++ = ' ';
+
+    if (state_ptr->ep_sq)
+        p = square_to_uci(state_ptr->ep_sq, p);
     else
+        *p++ = '-';
+
+    return p;
+}
+
+std::string Position::fen()
+{
+    char buf[MAX_FEN_LENGTH];
+    return std::string(buf, fen(buf));
+}
+
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 33, x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33, x *= 0xc4ceb9fe1a85ec53ull;
+    return x ^ x >> 33;
+}
+
+static uint64_t hash(const Bitboard *pieces, Color side_to_move, uint8_t castling_rights, Square ep_sq)
+{
+    // The state word is mixed on its own first: xored straight into the pawn step,
+    // an ep square and a pawn on a low square can cancel each other out
+
+    uint64_t k = mix(0x9e3779b97f4a7c15ull ^ (side_to_move | castling_rights << 1 | uint64_t(ep_sq) << 5));
+
+    for (Piece pc : { W_PAWN, W_KNIGHT, W_BISHOP, W_ROOK, W_QUEEN, W_KING,
+                      B_PAWN, B_KNIGHT, B_BISHOP, B_ROOK, B_QUEEN, B_KING })
+        k = mix(k ^ pieces[pc]);
+
+    return k;
+}
+
+// do_move() sets the ep square after every double push, so it only takes part
+// in a key when a pawn could capture there
+
+static Square capturable_ep(Color side_to_move)
+{
+    return Squares[state_ptr->ep_sq].pawn[!side_to_move] & bitboards[make_piece(side_to_move, PAWN)] ? state_ptr->ep_sq : 0;
+}
+
+// side_to_move is passed in because do_move() leaves it untouched inside a search
+
+uint64_t Position::key(Color side_to_move) {
+    return hash(bitboards, side_to_move, state_ptr->castling_rights, capturable_ep(side_to_move));
+}
+
+static Bitboard flip_vertical(Bitboard b) {
+    return __builtin_bswap64(b);
+}
+
+static Bitboard mirror_horizontal(Bitboard b)
+{
+    b = (b >> 1 & 0x5555555555555555ull) | (b & 0x5555555555555555ull) << 1;
+    b = (b >> 2 & 0x3333333333333333ull) | (b & 0x3333333333333333ull) << 2;
+    return (b >> 4 & 0x0f0f0f0f0f0f0f0full) | (b & 0x0f0f0f0f0f0f0f0full) << 4;
+}
+
+// Smallest key among the position and its color-flipped twin, plus both of their
+// left-right mirrors once no castling rights are left. All of them have the same
+// perft at every depth
+
+uint64_t Position::canonical_key(Color side_to_move)
+{
+    uint8_t  rights = state_ptr->castling_rights, flipped_rights = rights >> 2 | (rights & 3) << 2;
+    Square   ep = capturable_ep(side_to_move), flipped_ep = ep ? ep ^ 56 : 0;
+    Bitboard flipped[16];
+
+    for (PieceType pt = PAWN; pt <= KING; pt++)
     {
-        if (state_ptr->castling_rights & 0b1000) fen << "K";
-        if (state_ptr->castling_rights & 0b0100) fen << "Q";
-        if (state_ptr->castling_rights & 0b0010) fen << "k";
-        if (state_ptr->castling_rights & 0b0001) fen << "q";
+        flipped[make_piece(WHITE, pt)] = flip_vertical(bitboards[make_piece(BLACK, pt)]);
+        flipped[make_piece(BLACK, pt)] = flip_vertical(bitboards[make_piece(WHITE, pt)]);
     }
-  
-    fen << " " << (state_ptr->ep_sq ? square_to_uci(state_ptr->ep_sq) : "-");
 
-    return fen.str();
+    uint64_t k = std::min(hash(bitboards, side_to_move, rights, ep), hash(flipped, !side_to_move, flipped_rights, flipped_ep));
+
+    if (rights)
+        return k;
+
+    Bitboard mirrored[16], mirrored_flipped[16];
+
+    for (PieceType pt = PAWN; pt <= KING; pt++)
+        for (Color c : { WHITE, BLACK })
+        {
+            mirrored        [make_piece(c, pt)] = mirror_horizontal(bitboards[make_piece(c, pt)]);
+            mirrored_flipped[make_piece(c, pt)] = mirror_horizontal(flipped  [make_piece(c, pt)]);
+        }
+
+    return std::min({ k, hash(mirrored,         side_to_move,  0, ep         ? ep         ^ 7 : 0),
+                         hash(mirrored_flipped, !side_to_move, 0, flipped_ep ? flipped_ep ^ 7 : 0) });
 }
 
 void Position::commit_move(Move m)
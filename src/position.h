@@ -18,10 +18,12 @@ struct StateInfo
     Color   side_to_move;
 };
 
-extern Bitboard bitboards[16];
-extern Piece board[SQUARE_NB];
+// The position is per thread; a worker must call Position::set() before using it
 
-extern StateInfo state_stack[MAX_PLY], *state_ptr;
+inline thread_local Bitboard bitboards[16];
+inline thread_local Piece board[SQUARE_NB];
+
+inline thread_local StateInfo state_stack[MAX_PLY], *state_ptr;
 
 template<Piece P>
 inline Bitboard bitboard() { return bitboards[P]; }
@@ -30,9 +32,14 @@ inline Piece piece_on(Square s) { return board[s]; }
 
 namespace Position
 {    
-    void set(const std::string& fen);
+    // Both fail, and leave the position unusable, when the board is not eight
+    // ranks of eight squares or a side has other than one king. The buffer
+    // form returns the end of the fen, or nullptr on failure
+    bool set(const std::string& fen);
+    const char *set(const char *fen, const char *end);
     void commit_move(Move m);
     std::string fen();
+    char *fen(char *buf);
     std::string to_string();
 
     inline bool white_to_move() { return state_ptr->side_to_move == WHITE; }
@@ -40,6 +47,10 @@ namespace Position
     inline Bitboard occupied() { return bitboards[WHITE] | bitboards[BLACK]; }
     
     inline Bitboard ep_bb() { return square_bb(state_ptr->ep_sq); }
+
+    uint64_t key(Color side_to_move);
+    inline uint64_t key() { return key(state_ptr->side_to_move); }
+    uint64_t canonical_key(Color side_to_move);
 }
 
 template<Color JustMoved>
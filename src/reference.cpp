@@ -0,0 +1,223 @@
+
+#include "reference.h"
+
+#include <cstring>
+#include <initializer_list>
+
+// Squares are addressed by (file, rank) with file 0 = h, as in the square enum
+
+static bool on_board(int f, int r) {
+    return f >= 0 && f < 8 && r >= 0 && r < 8;
+}
+
+static Square square(int f, int r) {
+    return r * 8 + f;
+}
+
+static Piece piece_at(const Piece *b, int f, int r) {
+    return on_board(f, r) ? b[square(f, r)] : NO_PIECE;
+}
+
+static PieceType type_of_piece(Piece p) {
+    return p & 7;
+}
+
+static const int KnightSteps[8][2] = { {1,2}, {2,1}, {2,-1}, {1,-2}, {-1,-2}, {-2,-1}, {-2,1}, {-1,2} };
+static const int KingSteps  [8][2] = { {1,0}, {1,1}, {0,1}, {-1,1}, {-1,0}, {-1,-1}, {0,-1}, {1,-1} };
+static const int BishopDirs [4][2] = { {1,1}, {1,-1}, {-1,-1}, {-1,1} };
+static const int RookDirs   [4][2] = { {1,0}, {0,1}, {-1,0}, {0,-1} };
+
+static bool slider_attacks(const Piece *b, int f, int r, const int (*dirs)[2], Piece p1, Piece p2)
+{
+    for (int d = 0; d < 4; d++)
+        for (int tf = f + dirs[d][0], tr = r + dirs[d][1]; on_board(tf, tr); tf += dirs[d][0], tr += dirs[d][1])
+            if (Piece pc = b[square(tf, tr)])
+            {
+                if (pc == p1 || pc == p2)
+                    return true;
+                break;
+            }
+
+    return false;
+}
+
+bool Reference::attacked(const Piece *b, Square s, Color by)
+{
+    int f = s % 8, r = s / 8, down = by == WHITE ? -1 : 1;
+
+    if (piece_at(b, f + 1, r + down) == make_piece(by, PAWN) || piece_at(b, f - 1, r + down) == make_piece(by, PAWN))
+        return true;
+
+    for (int i = 0; i < 8; i++)
+        if (   piece_at(b, f + KnightSteps[i][0], r + KnightSteps[i][1]) == make_piece(by, KNIGHT)
+            || piece_at(b, f + KingSteps  [i][0], r + KingSteps  [i][1]) == make_piece(by, KING))
+            return true;
+
+    return slider_attacks(b, f, r, BishopDirs, make_piece(by, BISHOP), make_piece(by, QUEEN))
+        || slider_attacks(b, f, r, RookDirs,   make_piece(by, ROOK),   make_piece(by, QUEEN));
+}
+
+void Reference::apply(Piece *b, Move m)
+{
+    Square from = from_sq(m), to = to_sq(m);
+    Piece  pc   = b[from];
+
+    b[from] = NO_PIECE;
+    b[to]   = pc;
+
+    if (type_of(m) == PROMOTION)
+        b[to] = make_piece(color_of(pc), promotion_type(m));
+
+    else if (type_of(m) == ENPASSANT)
+        b[square(to % 8, from / 8)] = NO_PIECE;
+
+    else if (type_of(m) == CASTLING)
+    {
+        Square rook_from = to % 8 == 1 ? from - 3 : from + 4;
+        Square rook_to   = to % 8 == 1 ? from - 1 : from + 1;
+
+        b[rook_to]   = b[rook_from];
+        b[rook_from] = NO_PIECE;
+    }
+}
+
+uint8_t Reference::castling_rights(uint8_t rights, Move m)
+{
+    for (Square s : { from_sq(m), to_sq(m) })
+    {
+        if (s == E1) rights &= ~0b1100;
+        if (s == H1) rights &= ~0b1000;
+        if (s == A1) rights &= ~0b0100;
+        if (s == E8) rights &= ~0b0011;
+        if (s == H8) rights &= ~0b0010;
+        if (s == A8) rights &= ~0b0001;
+    }
+
+    return rights;
+}
+
+Square Reference::ep_square(const Piece *b, Move m)
+{
+    Square from = from_sq(m), to = to_sq(m);
+
+    if (type_of_piece(b[from]) == PAWN && (from / 8 - to / 8 == 2 || to / 8 - from / 8 == 2))
+        return (from + to) / 2;
+
+    return 0;
+}
+
+Move *Reference::generate_moves(const Piece *b, Color us, uint8_t castling_rights, Square ep_sq, Move *list)
+{
+    Move pseudo[256], *end = pseudo;
+
+    int up = us == WHITE ? 1 : -1;
+
+    for (Square s = H1; s <= A8; s++)
+    {
+        Piece pc = b[s];
+
+        if (!pc || color_of(pc) != us)
+            continue;
+
+        int f = s % 8, r = s / 8;
+
+        auto add = [&](int tf, int tr) {
+            if (!on_board(tf, tr))
+                return false;
+            Piece target = b[square(tf, tr)];
+            if (!target || color_of(target) != us)
+                *end++ = make_move(s, square(tf, tr));
+            return !target;
+        };
+
+        switch (type_of_piece(pc))
+        {
+        case PAWN:
+        {
+            Square targets[3];
+            int    n = 0;
+
+            if (!piece_at(b, f, r + up))
+            {
+                targets[n++] = square(f, r + up);
+
+                if (r == (us == WHITE ? 1 : 6) && !piece_at(b, f, r + 2 * up))
+                    *end++ = make_move(s, square(f, r + 2 * up));
+            }
+
+            for (int df : { -1, 1 })
+            {
+                if (!on_board(f + df, r + up))
+                    continue;
+
+                Square to = square(f + df, r + up);
+
+                if (b[to] && color_of(b[to]) != us)
+                    targets[n++] = to;
+
+                else if (   ep_sq && to == ep_sq && !b[to] && r == (us == WHITE ? 4 : 3)
+                         && b[square(f + df, r)] == make_piece(!us, PAWN))
+                    *end++ = make_move<ENPASSANT>(s, to);
+            }
+
+            for (int i = 0; i < n; i++)
+                if (targets[i] / 8 == (us == WHITE ? 7 : 0))
+                    for (Move type : { KNIGHT_PROMOTION, BISHOP_PROMOTION, ROOK_PROMOTION, QUEEN_PROMOTION })
+                        *end++ = type + make_move(s, targets[i]);
+                else
+                    *end++ = make_move(s, targets[i]);
+
+            break;
+        }
+        case KNIGHT:
+            for (int i = 0; i < 8; i++)
+                add(f + KnightSteps[i][0], r + KnightSteps[i][1]);
+            break;
+        case KING:
+            for (int i = 0; i < 8; i++)
+                add(f + KingSteps[i][0], r + KingSteps[i][1]);
+            break;
+        default:
+            for (int d = 0; d < 4; d++)
+            {
+                if (type_of_piece(pc) != ROOK)
+                    for (int k = 1; add(f + k * BishopDirs[d][0], r + k * BishopDirs[d][1]); k++);
+
+                if (type_of_piece(pc) != BISHOP)
+                    for (int k = 1; add(f + k * RookDirs[d][0], r + k * RookDirs[d][1]); k++);
+            }
+        }
+    }
+
+    Square   e = us == WHITE ? E1 : E8, a = e + 4, h = e - 3;
+    uint8_t  k = us == WHITE ? 0b1000 : 0b0010, q = us == WHITE ? 0b0100 : 0b0001;
+
+    if (b[e] == make_piece(us, KING) && !attacked(b, e, !us))
+    {
+        if (   castling_rights & k && b[h] == make_piece(us, ROOK) && !b[e - 1] && !b[e - 2]
+            && !attacked(b, e - 1, !us) && !attacked(b, e - 2, !us))
+            *end++ = make_move<CASTLING>(e, e - 2);
+
+        if (   castling_rights & q && b[a] == make_piece(us, ROOK) && !b[e + 1] && !b[e + 2] && !b[e + 3]
+            && !attacked(b, e + 1, !us) && !attacked(b, e + 2, !us))
+            *end++ = make_move<CASTLING>(e, e + 2);
+    }
+
+    for (Move *m = pseudo; m != end; m++)
+    {
+        Piece after[SQUARE_NB];
+
+        memcpy(after, b, sizeof(after));
+        apply(after, *m);
+
+        Square ksq = 0;
+
+        while (after[ksq] != make_piece(us, KING))
+            ksq++;
+
+        if (!attacked(after, ksq, !us))
+            *list++ = *m;
+    }
+
+    return list;
+}
@@ -0,0 +1,19 @@
+
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include "types.h"
+
+// Slow mailbox move generator used to cross-check the bitboard one.
+// Everything works on plain Piece[64] boards so it shares no tables with movegen.h
+
+namespace Reference
+{
+    bool attacked(const Piece *b, Square s, Color by);
+    void apply(Piece *b, Move m);
+    uint8_t castling_rights(uint8_t rights, Move m);
+    Square ep_square(const Piece *b, Move m);
+    Move *generate_moves(const Piece *b, Color us, uint8_t castling_rights, Square ep_sq, Move *list);
+}
+
+#endif
@@ -0,0 +1,265 @@
+
+#include "telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+#include "tt.h"
+
+using namespace Telemetry;
+
+// Layout of the shared memory segment. sequence is odd while the sampler
+// writes, so a reader copies the segment until it sees the same even value
+// before and after
+
+struct Shared
+{
+    char     magic[8];
+    uint64_t sequence;
+    uint64_t time_ms;  // Since the sampler started
+    uint64_t nodes, nodes_per_second, cache_hits, cache_misses, table_probes, table_hits;
+    uint64_t root_done, root_total, stalled_ms, threads;
+    uint64_t thread_nodes[MaxSlots];
+};
+
+constexpr char Magic[8] = { 'P', 'E', 'R', 'F', 'T', 'T', '0', '1' };
+
+struct Totals
+{
+    uint64_t nodes, cache_hits, cache_misses;
+    uint64_t thread_nodes[MaxSlots];
+    int      threads;
+};
+
+static std::mutex slots_mutex;
+static Slot       slots[MaxSlots];
+static Slot       overflow = { 0, 0, 0, true, true };
+static Totals     retired;
+
+static std::thread             sampler;
+static std::mutex              sampler_mutex;
+static std::condition_variable wake;
+static bool                    stopping;
+
+static Shared      *shared;
+static std::string  shm_name;
+
+static uint64_t load(const uint64_t& x) {
+    return __atomic_load_n(&x, __ATOMIC_RELAXED);
+}
+
+Slot *Telemetry::claim()
+{
+    std::lock_guard<std::mutex> lock(slots_mutex);
+
+    for (Slot& s : slots)
+        if (!s.used)
+            return s.used = true, &s;
+
+    return &overflow;
+}
+
+// The counts of a finished thread stay in the totals, its slot is reused
+
+void Telemetry::retire(Slot *slot)
+{
+    if (slot->shared)
+        return;
+
+    std::lock_guard<std::mutex> lock(slots_mutex);
+
+    retired.nodes        += load(slot->nodes);
+    retired.cache_hits   += load(slot->cache_hits);
+    retired.cache_misses += load(slot->cache_misses);
+
+    *slot = {};
+}
+
+static Totals sum()
+{
+    std::lock_guard<std::mutex> lock(slots_mutex);
+
+    Totals t = retired;
+
+    for (int i = 0; i < MaxSlots; i++)
+        if (slots[i].used)
+        {
+            uint64_t n = load(slots[i].nodes);
+
+            t.nodes        += n;
+            t.cache_hits   += load(slots[i].cache_hits);
+            t.cache_misses += load(slots[i].cache_misses);
+
+            t.thread_nodes[t.threads++] = n;
+        }
+
+    // The overflow slot shows up as one more thread once anybody uses it
+
+    if (uint64_t n = load(overflow.nodes))
+    {
+        t.nodes        += n;
+        t.cache_hits   += load(overflow.cache_hits);
+        t.cache_misses += load(overflow.cache_misses);
+
+        if (t.threads < MaxSlots)
+            t.thread_nodes[t.threads++] = n;
+    }
+
+    return t;
+}
+
+// Written to a temporary file and renamed, so a scraper never reads half a sample
+
+static void write_prometheus(const std::string& path, const Totals& t, double nps, double stalled, double uptime)
+{
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+
+    if (!f)
+        return;
+
+    auto metric = [&](const char *name, const char *type, const char *help, double value)
+    {
+        fprintf(f, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+    };
+
+    metric("perft_nodes_total",          "counter", "Leaves counted by search, subtree table hits excluded", t.nodes);
+    metric("perft_nodes_per_second",     "gauge",   "Search rate over the last interval", nps);
+    metric("perft_cache_hits_total",     "counter", "Persistent cache probes that hit", t.cache_hits);
+    metric("perft_cache_misses_total",   "counter", "Persistent cache probes that missed", t.cache_misses);
+    metric("perft_table_probes_total",   "counter", "Subtree table probes", load(tt_probes));
+    metric("perft_table_hits_total",     "counter", "Subtree table probes that hit", load(tt_hits));
+    metric("perft_root_done",            "gauge",   "Root moves or batch chunks finished", load(root_done));
+    metric("perft_root_total",           "gauge",   "Root moves or batch chunks of the running command", load(root_total));
+    metric("perft_stalled_seconds",      "gauge",   "Time since the node count last grew", stalled);
+    metric("perft_uptime_seconds",       "gauge",   "Time since telemetry started", uptime);
+
+    fprintf(f, "# HELP perft_thread_nodes Leaves counted by each live thread\n# TYPE perft_thread_nodes gauge\n");
+
+    for (int i = 0; i < t.threads; i++)
+        fprintf(f, "perft_thread_nodes{thread=\"%d\"} %llu\n", i, (unsigned long long)t.thread_nodes[i]);
+
+    fclose(f);
+    rename(tmp.c_str(), path.c_str());
+}
+
+static void write_shared(const Totals& t, uint64_t nps, uint64_t stalled_ms, uint64_t time_ms)
+{
+    __atomic_store_n(&shared->sequence, shared->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    shared->time_ms          = time_ms;
+    shared->nodes            = t.nodes;
+    shared->nodes_per_second = nps;
+    shared->cache_hits       = t.cache_hits;
+    shared->cache_misses     = t.cache_misses;
+    shared->table_probes     = load(tt_probes);
+    shared->table_hits       = load(tt_hits);
+    shared->root_done        = load(root_done);
+    shared->root_total       = load(root_total);
+    shared->stalled_ms       = stalled_ms;
+    shared->threads          = t.threads;
+
+    memcpy(shared->thread_nodes, t.thread_nodes, sizeof(shared->thread_nodes));
+
+    __atomic_store_n(&shared->sequence, shared->sequence + 1, __ATOMIC_RELEASE);
+}
+
+static void sample(const std::string& file, int interval_ms)
+{
+    using clock = std::chrono::steady_clock;
+
+    auto     start = clock::now(), last = start, grown = start;
+    uint64_t last_nodes = sum().nodes;
+
+    for (std::unique_lock<std::mutex> lock(sampler_mutex); !stopping;)
+    {
+        wake.wait_for(lock, std::chrono::milliseconds(interval_ms));
+
+        Totals t   = sum();
+        auto   now = clock::now();
+
+        if (t.nodes != last_nodes)
+            grown = now;
+
+        auto   ms      = [&](clock::time_point p) { return std::chrono::duration<double, std::milli>(now - p).count(); };
+        double nps     = (t.nodes - last_nodes) / (ms(last) / 1000 + 1e-9);
+        double stalled = ms(grown) / 1000;
+
+        if (!file.empty())
+            write_prometheus(file, t, nps, stalled, ms(start) / 1000);
+
+        if (shared)
+            write_shared(t, nps, ms(grown), ms(start));
+
+        last = now, last_nodes = t.nodes;
+    }
+}
+
+bool Telemetry::start(const std::string& file, const std::string& shm, int interval_ms)
+{
+    stop();
+
+    if (!shm.empty())
+    {
+        int fd = shm_open(shm.c_str(), O_CREAT | O_RDWR, 0644);
+
+        if (fd < 0 || ftruncate(fd, sizeof(Shared)))
+        {
+            if (fd >= 0) close(fd);
+            return false;
+        }
+
+        void *p = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (p == MAP_FAILED)
+            return false;
+
+        shared   = (Shared *)p;
+        shm_name = shm;
+
+        memset(shared, 0, sizeof(Shared));
+        memcpy(shared->magic, Magic, sizeof(Magic));
+    }
+
+    stopping = false;
+    sampler  = std::thread(sample, file, std::max(1, interval_ms));
+
+    __atomic_store_n(&active, true, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+// The last sample stays in the file and the segment is unlinked
+
+void Telemetry::stop()
+{
+    __atomic_store_n(&active, false, __ATOMIC_RELAXED);
+
+    if (sampler.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(sampler_mutex);
+            stopping = true;
+        }
+
+        wake.notify_all();
+        sampler.join();
+    }
+
+    if (shared)
+    {
+        munmap(shared, sizeof(Shared));
+        shm_unlink(shm_name.c_str());
+        shared = nullptr;
+    }
+}
@@ -0,0 +1,70 @@
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <string>
+
+// Opt-in live counters for long runs. Every counting thread owns a slot and
+// adds to it with relaxed stores, once per unrolled subtree rather than per
+// node. While started, a sampler thread sums the slots every interval and
+// publishes the totals to a Prometheus text file and/or a shared memory segment.
+// Nothing is counted, and no thread claims a slot, while no sampler runs
+
+namespace Telemetry
+{
+    constexpr int MaxSlots = 256;
+
+    struct alignas(64) Slot
+    {
+        uint64_t nodes, cache_hits, cache_misses;
+        bool     used;
+        bool     shared;  // The overflow slot, added to with atomic adds
+    };
+
+    // Threads past MaxSlots share one overflow slot, which is never retired
+    Slot *claim();
+    void  retire(Slot *slot);
+
+    struct Handle
+    {
+        Slot *slot = claim();
+        ~Handle() { retire(slot); }
+    };
+
+    inline thread_local Handle local;
+    inline bool                active;
+
+    inline bool enabled() {
+        return __builtin_expect(__atomic_load_n(&active, __ATOMIC_RELAXED), false);
+    }
+
+    inline void add(uint64_t Slot::*counter, uint64_t n)
+    {
+        Slot *s = local.slot;
+
+        if (s->shared)
+            __atomic_fetch_add(&(s->*counter), n, __ATOMIC_RELAXED);
+        else
+            __atomic_store_n(&(s->*counter), __atomic_load_n(&(s->*counter), __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+    }
+
+    inline void nodes(uint64_t n)   { if (enabled()) add(&Slot::nodes, n); }
+    inline void cache_hit()         { if (enabled()) add(&Slot::cache_hits, 1); }
+    inline void cache_miss()        { if (enabled()) add(&Slot::cache_misses, 1); }
+
+    // Root moves, or batch chunks, finished so far by the running command
+    inline uint64_t root_done, root_total;
+
+    inline void progress(uint64_t done, uint64_t total)
+    {
+        __atomic_store_n(&root_done,  done,  __ATOMIC_RELAXED);
+        __atomic_store_n(&root_total, total, __ATOMIC_RELAXED);
+    }
+
+    // Either of file and shm may be empty. shm is a POSIX name like "/perft"
+    bool start(const std::string& file, const std::string& shm, int interval_ms);
+    void stop();
+}
+
+#endif
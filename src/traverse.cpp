@@ -0,0 +1,136 @@
+
+#include "traverse.h"
+
+#include <iostream>
+
+#include "movegen.h"
+#include "perft.h"
+#include "position.h"
+#include "telemetry.h"
+#include "tt.h"
+#include "uci.h"
+
+struct Frame
+{
+    Move      list[128], *cur, *end;
+    uint64_t  keys[128];
+    uint64_t  key;
+    NodeCount nodes;
+    int       depth;
+};
+
+static thread_local Frame frames[MAX_PLY];
+
+// Generates the moves of the frame and starts the loads of its children's buckets
+
+template<Color Us>
+void expand(Frame& f)
+{
+    f.end   = generate_moves<Us>(f.list);
+    f.cur   = f.list;
+    f.nodes = 0;
+
+    if (f.depth - 1 < tt_min_depth)
+        return;
+
+    for (Move *m = f.list; m != f.end; m++)
+    {
+        do_move<Us>(*m);
+        uint64_t key = Position::canonical_key(!Us);
+        undo_move<Us>(*m);
+
+        f.keys[m - f.list] = key;
+        TT::prefetch(key);
+    }
+}
+
+// Runs one step at the top frame: descends into the next child, or finishes
+// the frame and hands its count to the parent. Returns false once the root is done
+
+template<Color Us>
+bool step(int& ply, bool divide)
+{
+    Frame& f = frames[ply];
+
+    if (f.cur == f.end)
+    {
+        if (ply == 0)
+            return false;
+
+        TT::store(f.key, f.depth, f.nodes);
+
+        Frame& parent = frames[--ply];
+        undo_move<!Us>(*parent.cur);
+
+        parent.nodes += f.nodes;
+
+        if (divide && ply == 0)
+        {
+            char line[48];
+            std::cout.write(line, divide_line(*parent.cur, f.nodes, line) - line);
+        }
+
+        if (ply == 0)
+            Telemetry::progress(parent.cur - parent.list + 1, parent.end - parent.list);
+
+        parent.cur++;
+        return true;
+    }
+
+    int depth = f.depth - 1;
+    NodeCount count;
+
+    do_move<Us>(*f.cur);
+
+    if (depth >= tt_min_depth && !TT::probe(f.keys[f.cur - f.list], depth, count))
+    {
+        Frame& child = frames[++ply];
+
+        child.key   = f.keys[f.cur - f.list];
+        child.depth = depth;
+        expand<!Us>(child);
+
+        return true;
+    }
+
+    if (depth < tt_min_depth)
+        count = PerfT<false, !Us>(depth);
+
+    undo_move<Us>(*f.cur);
+
+    f.nodes += count;
+
+    if (divide && ply == 0)
+    {
+        char line[48];
+        std::cout.write(line, divide_line(*f.cur, count, line) - line);
+    }
+
+    if (ply == 0)
+        Telemetry::progress(f.cur - f.list + 1, f.end - f.list);
+
+    f.cur++;
+    return true;
+}
+
+NodeCount Traverse::sym_perft(int depth, bool divide)
+{
+    if (depth == 0)
+        return 1;
+
+    Color root = state_ptr->side_to_move;
+    int   ply  = 0;
+
+    frames[0].depth = depth;
+
+    if (root == WHITE) expand<WHITE>(frames[0]);
+    else               expand<BLACK>(frames[0]);
+
+    // The side to move at a ply follows from its parity, do_move() does not track it
+
+    while ((root == WHITE) == !(ply & 1) ? step<WHITE>(ply, divide) : step<BLACK>(ply, divide));
+
+    TT::store(Position::canonical_key(root), depth, frames[0].nodes);
+
+    return frames[0].nodes;
+}
@@ -0,0 +1,16 @@
+
+#ifndef TRAVERSE_H
+#define TRAVERSE_H
+
+#include "types.h"
+
+namespace Traverse
+{
+    // Same count as SymPerfT(), walked with an explicit stack. Every node keys
+    // and prefetches the table buckets of all its children before descending, so
+    // each load is in flight while the subtrees of earlier siblings are searched.
+    // With divide set the root moves are printed as they complete
+    NodeCount sym_perft(int depth, bool divide);
+}
+
+#endif
@@ -0,0 +1,24 @@
+
+#include "tt.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+bool TT::resize(size_t mb)
+{
+    free(tt_table);
+
+    tt_buckets = std::max<size_t>(1, (mb << 20) / sizeof(TTBucket));
+    tt_table   = (TTBucket *)aligned_alloc(sizeof(TTBucket), tt_buckets * sizeof(TTBucket));
+
+    __atomic_store_n(&tt_probes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&tt_hits,   0, __ATOMIC_RELAXED);
+
+    if (!tt_table)
+        return tt_buckets = 0, false;
+
+    memset(tt_table, 0, tt_buckets * sizeof(TTBucket));
+
+    return true;
+}
@@ -0,0 +1,79 @@
+
+#ifndef TT_H
+#define TT_H
+
+#include <stddef.h>
+
+#include "types.h"
+
+// In-memory subtree table: (key, depth) -> nodes, four entries per cache line.
+// Counts of 2^56 or more are not stored
+
+struct TTEntry
+{
+    uint64_t key;
+    uint64_t data;  // nodes << 8 | depth
+};
+
+struct alignas(64) TTBucket {
+    TTEntry entry[4];
+};
+
+inline TTBucket *tt_table;
+inline size_t    tt_buckets;
+inline uint64_t  tt_probes, tt_hits;  // Read by the telemetry sampler, see count()
+
+// Subtrees shallower than this are counted without the table. Lower values trade
+// search for many more, mostly missing, table accesses
+inline int tt_min_depth = 3;
+
+namespace TT
+{
+    // Returns false, with no table, when the memory can't be allocated
+    bool resize(size_t mb);
+
+    // Relaxed atomic increment, plain adds on the one searching thread
+    inline void count(uint64_t& counter) {
+        __atomic_store_n(&counter, __atomic_load_n(&counter, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    }
+
+    inline TTBucket& bucket(uint64_t key) {
+        return tt_table[(unsigned __int128)key * tt_buckets >> 64];
+    }
+
+    inline void prefetch(uint64_t key) {
+        __builtin_prefetch(&bucket(key));
+    }
+
+    inline bool probe(uint64_t key, int depth, NodeCount& nodes)
+    {
+        count(tt_probes);
+
+        for (TTEntry& e : bucket(key).entry)
+            if (e.key == key && int(e.data & 0xff) == depth)
+                return nodes = e.data >> 8, count(tt_hits), true;
+
+        return false;
+    }
+
+    inline void store(uint64_t key, int depth, NodeCount nodes)
+    {
+        if (nodes >> 56)
+            return;
+
+        TTEntry *replace = bucket(key).entry;
+
+        for (TTEntry& e : bucket(key).entry)
+        {
+            if (e.key == key && int(e.data & 0xff) == depth)
+                return;
+
+            if ((e.data & 0xff) < (replace->data & 0xff))
+                replace = &e;
+        }
+
+        *replace = { key, uint64_t(nodes) << 8 | depth };
+    }
+}
+
+#endif
@@ -13,10 +13,16 @@ typedef uint8_t  Color;
 typedef int8_t   Direction;
 typedef int8_t   Square;
 
+// Leaf totals. Startpos perft(14) already passes 2^64, so anything that sums
+// subtrees of unbounded depth counts in 128 bits
+typedef unsigned __int128 NodeCount;
+
 constexpr Move NULLMOVE = 0;
 
 constexpr int MAX_PLY = 64;
 
+constexpr int MAX_FEN_LENGTH = 96;
+
 enum { WHITE, BLACK, COLOR_NB = 2 };
 
 enum {
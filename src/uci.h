@@ -2,14 +2,88 @@
 #ifndef UCI_H
 #define UCI_H
 
+#include <algorithm>
+#include <charconv>
 #include <string>
 
 #include "movegen.h"
 #include "position.h"
 #include "types.h"
 
-inline std::string square_to_uci(Square sq) {
-    return std::string(1, "hgfedcba"[sq % 8]) + std::string(1, "12345678"[sq / 8]);
+// The char * overloads write into a caller's buffer and return the new end
+
+inline char *square_to_uci(Square sq, char *buf)
+{
+    *buf++ = "hgfedcba"[sq % 8];
+    *buf++ = "12345678"[sq / 8];
+    return buf;
+}
+
+inline char *move_to_uci(Move m, char *buf)
+{
+    buf = square_to_uci(to_sq(m), square_to_uci(from_sq(m), buf));
+
+    if (type_of(m) == PROMOTION)
+        *buf++ = "   nbrq"[promotion_type(m)];
+
+    return buf;
+}
+
+// Decimal digits of a count, at most 39 bytes. Counts that fit 64 bits take the
+// library's path, wider ones are divided down digit by digit
+
+inline char *count_to_chars(NodeCount n, char *buf)
+{
+    if (!(n >> 64))
+        return std::to_chars(buf, buf + 20, uint64_t(n)).ptr;
+
+    char digits[39], *p = digits + 39;
+
+    for (; n; n /= 10)
+        *--p = '0' + n % 10;
+
+    return std::copy(p, digits + 39, buf);
+}
+
+inline std::string count_to_string(NodeCount n)
+{
+    char buf[39];
+    return std::string(buf, count_to_chars(n, buf));
+}
+
+// Reads a whole token of decimal digits, false on anything else or on overflow
+
+inline bool string_to_count(const std::string& s, NodeCount& n)
+{
+    n = 0;
+
+    for (char c : s)
+    {
+        if (c < '0' || c > '9' || n > (~NodeCount(0) - (c - '0')) / 10)
+            return false;
+
+        n = n * 10 + (c - '0');
+    }
+
+    return !s.empty();
+}
+
+// "<move>: <count>\n", at most 47 bytes
+
+inline char *divide_line(Move m, NodeCount count, char *buf)
+{
+    buf = move_to_uci(m, buf);
+    *buf++ = ':';
+    *buf++ = ' ';
+    buf = count_to_chars(count, buf);
+    *buf++ = '\n';
+    return buf;
+}
+
+inline std::string square_to_uci(Square sq)
+{
+    char buf[2];
+    return std::string(buf, square_to_uci(sq, buf));
 }
 
 inline Square uci_to_square(const std::string& uci) {
@@ -18,18 +92,95 @@ inline Square uci_to_square(const std::string& uci) {
 
 inline std::string move_to_uci(Move m)
 {
-    return type_of(m) == PROMOTION ? square_to_uci(from_sq(m)) + square_to_uci(to_sq(m)) + "   nbrq"[promotion_type(m)]
-                                   : square_to_uci(from_sq(m)) + square_to_uci(to_sq(m));
+    char buf[5];
+    return std::string(buf, move_to_uci(m, buf));
 }
 
-inline Move uci_to_move(const std::string& uci)
+// Finds the legal move a "<from><to>[promotion]" token stands for, matching
+// squares and promotion piece directly. NULLMOVE if the token is not legal here
+
+inline Move uci_to_move(const char *p, const char *end)
 {
-    for (Move list[128], *m = list, *end = Position::white_to_move() ? generate_moves<WHITE>(list)
-                                                                     : generate_moves<BLACK>(list); m != end; m++)
-        if (move_to_uci(*m) == uci) return *m;
+    if (end - p < 4 || end - p > 5 || p[0] < 'a' || p[0] > 'h' || p[1] < '1' || p[1] > '8'
+                                   || p[2] < 'a' || p[2] > 'h' || p[3] < '1' || p[3] > '8')
+        return NULLMOVE;
+
+    Square    from  = 8 * (p[1] - '1') + 'h' - p[0];
+    Square    to    = 8 * (p[3] - '1') + 'h' - p[2];
+    PieceType promo = 0;
+
+    // An unknown promotion letter is given a piece no move promotes to
+    if (end - p == 5)
+        promo = p[4] == 'n' ? KNIGHT : p[4] == 'b' ? BISHOP : p[4] == 'r' ? ROOK : p[4] == 'q' ? QUEEN : KING;
+
+    for (Move list[128], *m = list, *list_end = Position::white_to_move() ? generate_moves<WHITE>(list)
+                                                                          : generate_moves<BLACK>(list); m != list_end; m++)
+        if (from_sq(*m) == from && to_sq(*m) == to && (type_of(*m) == PROMOTION ? promotion_type(*m) : 0) == promo)
+            return *m;
 
     return NULLMOVE;
 }
 
-#endif
+inline Move uci_to_move(const std::string& uci) {
+    return uci_to_move(uci.data(), uci.data() + uci.size());
+}
+
+// Same for a SAN token such as "Nbxd7+", "exd8=Q" or "O-O-O". Check and
+// annotation marks are ignored; the moving piece, destination, promotion and any
+// file or rank given for the origin must all match
+
+inline Move san_to_move(const char *p, const char *end)
+{
+    while (end > p && (end[-1] == '+' || end[-1] == '#' || end[-1] == '!' || end[-1] == '?'))
+        end--;
+
+    Move list[128], *list_end = Position::white_to_move() ? generate_moves<WHITE>(list)
+                                                          : generate_moves<BLACK>(list);
+
+    if (end - p >= 3 && (p[0] == 'O' || p[0] == '0'))
+    {
+        // O-O lands the king on the g file, O-O-O on the c file
+        int file = end - p >= 5 ? C1 : G1;
 
+        for (Move *m = list; m != list_end; m++)
+            if (type_of(*m) == CASTLING && to_sq(*m) % 8 == file)
+                return *m;
+
+        return NULLMOVE;
+    }
+
+    auto piece_type = [](char c) -> PieceType {
+        return c == 'N' ? KNIGHT : c == 'B' ? BISHOP : c == 'R' ? ROOK : c == 'Q' ? QUEEN : c == 'K' ? KING : 0;
+    };
+
+    PieceType pt = piece_type(*p) ? piece_type(*p++) : PAWN, promo = 0;
+
+    if (end - p >= 2 && piece_type(end[-1]) && piece_type(end[-1]) != KING)
+    {
+        promo = piece_type(*--end);
+        end -= end[-1] == '=';
+    }
+
+    if (end - p < 2 || end[-2] < 'a' || end[-2] > 'h' || end[-1] < '1' || end[-1] > '8')
+        return NULLMOVE;
+
+    Square to = 8 * (end[-1] - '1') + 'h' - end[-2];
+    int from_file = -1, from_rank = -1;
+
+    for (; p < end - 2; p++)
+        if (*p >= 'a' && *p <= 'h')      from_file = 'h' - *p;
+        else if (*p >= '1' && *p <= '8') from_rank = *p - '1';
+
+    for (Move *m = list; m != list_end; m++)
+        if (   to_sq(*m) == to
+            && type_of(*m) != CASTLING
+            && (piece_on(from_sq(*m)) & 7) == pt
+            && (from_file < 0 || from_sq(*m) % 8 == from_file)
+            && (from_rank < 0 || from_sq(*m) / 8 == from_rank)
+            && (type_of(*m) == PROMOTION ? promotion_type(*m) : 0) == promo)
+            return *m;
+
+    return NULLMOVE;
+}
+
+#endif
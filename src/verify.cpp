@@ -0,0 +1,223 @@
+
+#include "verify.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "misc.h"
+#include "movegen.h"
+#include "position.h"
+#include "reference.h"
+#include "uci.h"
+
+constexpr int MaxGamePly = 300;
+
+struct Snapshot
+{
+    Bitboard  bitboards[16];
+    Piece     board[SQUARE_NB];
+    StateInfo state;
+    int       ply;
+
+    static Snapshot take()
+    {
+        Snapshot s;
+        memcpy(s.bitboards, ::bitboards, sizeof(s.bitboards));
+        memcpy(s.board, ::board, sizeof(s.board));
+        s.state = *state_ptr;
+        s.ply = state_ptr - state_stack;
+        return s;
+    }
+
+    bool operator==(const Snapshot& o) const
+    {
+        return !memcmp(bitboards, o.bitboards, sizeof(bitboards))
+            && !memcmp(board, o.board, sizeof(board))
+            && state.ep_sq == o.state.ep_sq
+            && state.castling_rights == o.state.castling_rights
+            && state.side_to_move == o.state.side_to_move
+            && ply == o.ply;
+    }
+};
+
+static bool consistent()
+{
+    Bitboard expected[16] = {};
+
+    for (Square s = H1; s <= A8; s++)
+        if (Piece pc = board[s])
+        {
+            expected[pc] |= square_bb(s);
+            expected[color_of(pc)] |= square_bb(s);
+        }
+
+    return !memcmp(expected, bitboards, sizeof(expected));
+}
+
+static std::string describe(const char *what, Move m) {
+    return std::string(what) + " " + move_to_uci(m);
+}
+
+// Runs every check on the current position and returns a description of the
+// first failure, or an empty string
+
+template<Color Us>
+std::string check_position()
+{
+    Move fast[256], *fast_end = generate_moves<Us>(fast);
+    Move ref [256], *ref_end  = Reference::generate_moves(board, Us, state_ptr->castling_rights, state_ptr->ep_sq, ref);
+
+    std::sort(fast, fast_end);
+    std::sort(ref, ref_end);
+
+    for (Move *f = fast, *r = ref; f != fast_end || r != ref_end;)
+    {
+        if (r == ref_end || f != fast_end && *f < *r) return describe("illegal move generated:", *f);
+        if (f == fast_end || *r < *f)                 return describe("legal move missing:", *r);
+        f++, r++;
+    }
+
+    Snapshot before = Snapshot::take();
+    std::string fen = Position::fen();
+
+    Position::set(fen);
+
+    if (!(Snapshot::take() == before) || Position::fen() != fen)
+        return "fen round trip changed the position";
+
+    for (Move *m = fast; m != fast_end; m++)
+    {
+        Piece after[SQUARE_NB];
+
+        memcpy(after, board, sizeof(after));
+        Reference::apply(after, *m);
+
+        Square ep = Reference::ep_square(board, *m);
+
+        do_move<Us>(*m);
+
+        if (!consistent())
+            return describe("bitboards and board disagree after", *m);
+
+        if (memcmp(after, board, sizeof(after)))
+            return describe("wrong board after", *m);
+
+        if (state_ptr->ep_sq != ep || state_ptr->castling_rights != Reference::castling_rights(before.state.castling_rights, *m))
+            return describe("wrong state after", *m);
+
+        undo_move<Us>(*m);
+
+        if (!(Snapshot::take() == before))
+            return describe("undo did not restore the position after", *m);
+    }
+
+    return "";
+}
+
+static std::string check_position() {
+    return Position::white_to_move() ? check_position<WHITE>() : check_position<BLACK>();
+}
+
+// Greedily removes pieces from a failing position for as long as it keeps failing
+
+static std::string minimize(std::string fen)
+{
+    for (bool progress = true; progress;)
+    {
+        progress = false;
+
+        for (Square s = H1; s <= A8 && !progress; s++)
+        {
+            Position::set(fen);
+
+            Piece pc = board[s];
+
+            if (!pc || pc == W_KING || pc == B_KING)
+                continue;
+
+            board[s] = NO_PIECE;
+            bitboards[pc] ^= square_bb(s);
+            bitboards[color_of(pc)] ^= square_bb(s);
+
+            state_ptr->castling_rights = Reference::castling_rights(state_ptr->castling_rights, make_move(s, s));
+
+            if (state_ptr->ep_sq == s + (color_of(pc) == WHITE ? SOUTH : NORTH))
+                state_ptr->ep_sq = 0;
+
+            Color them = !state_ptr->side_to_move;
+            Square ksq = lsb(bitboards[make_piece(them, KING)]);
+
+            if (Reference::attacked(board, ksq, !them))
+                continue;
+
+            std::string candidate = Position::fen();
+
+            if (!check_position().empty())
+                fen = candidate, progress = true;
+        }
+    }
+
+    return fen;
+}
+
+bool Verify::run(const std::string& root, uint64_t games, int threads)
+{
+    std::atomic<uint64_t> started(0), finished(0), positions(0);
+    std::atomic<bool>     failed(false);
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&, t]
+        {
+            PRNG rng(0x1f2e3d4c5b6a7988ull * (t + 1));
+
+            while (!failed && started++ < games)
+            {
+                Position::set(root);
+
+                for (int ply = 0; ply < MaxGamePly && !failed; ply++)
+                {
+                    std::string fen = Position::fen(), error = check_position();
+                    positions++;
+
+                    if (!error.empty())
+                    {
+                        if (failed.exchange(true))
+                            return;
+
+                        std::string minimal = minimize(fen);
+
+                        std::cout << "\nDivergence: " << error << "\nPosition: " << fen
+                                  << "\nMinimal reproducer: " << minimal << "\n" << std::endl;
+                        return;
+                    }
+
+                    Move list[256], *end = Position::white_to_move() ? generate_moves<WHITE>(list)
+                                                                     : generate_moves<BLACK>(list);
+                    if (end == list)
+                        break;
+
+                    Position::commit_move(list[rng.below(end - list)]);
+                }
+
+                finished++;
+            }
+        });
+
+    for (std::thread& th : workers)
+        th.join();
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "\nGames verified: " << finished << "\nPositions verified: " << positions
+              << "\nIn " << ms << " ms (" << positions * 1000 / (ms + 1) << " positions/s)\n"
+              << (failed ? "FAILED\n" : "ALL OK\n") << std::endl;
+
+    return !failed;
+}
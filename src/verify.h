@@ -0,0 +1,15 @@
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+#include <string>
+
+namespace Verify
+{
+    // Plays random games from fen on every thread and cross-checks movegen, fen and
+    // do/undo against the reference generator. Returns false on the first divergence
+    bool run(const std::string& fen, uint64_t games, int threads);
+}
+
+#endif